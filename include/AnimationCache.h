@@ -0,0 +1,65 @@
+#ifndef GARLAND_ANIMATION_CACHE
+#define GARLAND_ANIMATION_CACHE
+
+#include <Arduino.h>
+#include <list>
+#include <unordered_map>
+
+#include "LuaAnimation.h"
+
+class StringHash
+{
+public:
+    size_t operator()(const String& value) const;
+};
+
+// Loaded shaders by name, most recently used first. Bounded by the lua heap the states hold,
+// which grows after load, so the bound is checked again on every insert and eviction request.
+// The most recently used and the pinned animations are never evicted
+class AnimationCache
+{
+public:
+    virtual ~AnimationCache();
+
+    // moves a hit to the front and counts hits and misses
+    LuaAnimation* get(const String& name);
+    // looks up without touching the order or the counters
+    LuaAnimation* peek(const String& name);
+    // takes ownership, the animation goes to the front
+    void put(LuaAnimation* animation);
+    // removes without deleting, the caller owns the animation
+    LuaAnimation* detach(const String& name);
+    void erase(const String& name);
+    void clear();
+
+    // 0 is unbounded
+    void setMaxBytes(size_t maxBytes);
+    // the shown animation and the outgoing one of a transition
+    void setPinned(LuaAnimation* animation, LuaAnimation* outgoing = nullptr);
+    // evicts least recently used animations until the bound holds
+    void trim();
+    // evicts least recently used animations not using the skipped allocator until bytes are freed, returns freed
+    // bytes. Animations in a shared state only drop their globals, memory comes back with its next collection.
+    // Must not run inside an allocation of a state whose animations it may delete
+    size_t evict(size_t bytes, LuaAllocator* skipped);
+
+    std::list<LuaAnimation*>& getAnimations();
+    size_t getBytes();
+    uint32_t getHits();
+    uint32_t getMisses();
+    uint32_t getEvictions();
+private:
+    std::list<LuaAnimation*> animations;
+    std::unordered_map<String, std::list<LuaAnimation*>::iterator, StringHash> index;
+    LuaAnimation* pinned = nullptr;
+    LuaAnimation* pinnedOutgoing = nullptr;
+    size_t maxBytes = 0;
+
+    uint32_t hits = 0;
+    uint32_t misses = 0;
+    uint32_t evictions = 0;
+
+    void remove(std::list<LuaAnimation*>::iterator entry);
+};
+
+#endif //GARLAND_ANIMATION_CACHE
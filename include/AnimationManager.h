@@ -3,64 +3,233 @@
 
 #include <Arduino.h>
 #include <vector>
+#include <map>
 
 #include "ShaderStorage.h"
 #include "GlobalAnimationEnv.h"
 #include "LuaAnimation.h"
+#include "AnimationCache.h"
 #include "SelectAnimationListener.h"
+#include "RenderStats.h"
+#include "RenderSettings.h"
+#include "FrameBuffers.h"
+#include "RecursiveLock.h"
+#include "LedOutputs.h"
+#include "PostProcess.h"
+#include "Transition.h"
 
-#define CACHE_SIZE 5
+#define FX_BENCHMARK_MAX_FRAMES 200
+
+// shaders are evaluated on the arduino core while frames are clocked out next to wifi
+#define RENDER_TASK_CORE 1
+#define RENDER_TASK_PRIORITY 2
+#define RENDER_TASK_STACK 8192
+#define OUTPUT_TASK_CORE 0
+#define OUTPUT_TASK_PRIORITY 2
+#define OUTPUT_TASK_STACK 4096
+#define WORKER_TASK_CORE 0
+#define WORKER_TASK_PRIORITY 2
+#define WORKER_TASK_STACK 8192
+// selected shaders and the ones next to the current one load below frame priority in the time the output core leaves idle
+#define LOADER_TASK_CORE 0
+#define LOADER_TASK_PRIORITY 1
+#define LOADER_TASK_STACK 8192
+// a speculative load never pushes the heap below this, it would only evict shaders that were used
+#define PRELOAD_MIN_FREE_HEAP (48 * 1024)
+
+class FxBenchmark
+{
+public:
+    int frames = 0;
+    size_t pixels = 0;
+    uint32_t fxMicros = 0;
+    uint32_t floatMicros = 0;
+};
 
 class AnimationManager
 {
 private:
-    CRGB *leds;
+    // leds is the canvas shaders draw on, output is the frame on the strip,
+    // wire is output in the color order of each strip and the buffer FastLED sends out
+    CRGB *leds = nullptr;
+    CRGB *lastFrame = nullptr;
+    CRGB *output = nullptr;
+    CRGB *wire = nullptr;
+    std::vector<LedOutput> outputs;
+    PostProcess post;
+    FrameBuffers *frames = nullptr;
     size_t size;
-    int speed = 100;
+
+    // the output task blends from what is on the strip to the latest keyframe while shaders render below targetFps
+    CRGB *keyframeFrom = nullptr;
+    CRGB *keyframeTo = nullptr;
+    uint32_t keyframeStartMicros = 0;
+    bool blendDone = true;
+    uint32_t nextOutputMicros = 0;
+    uint32_t outputWindowStart = 0;
+    uint16_t outputWindowFrames = 0;
 
     GlobalAnimationEnv* globalAnimationEnv;
     ShaderStorage *shaderStorage;
 
     std::vector<String>* shaders = new std::vector<String>();
-    std::vector<LuaAnimation*>* loadedAnimations;
+    AnimationCache* cache;
+    LuaRuntime* sharedRuntime = nullptr;
+    // bumped on reload and shader edits, a load started before it is dropped
+    uint32_t cacheGeneration = 0;
+    // subsample factors set over the api, kept for shaders leaving the cache
+    std::map<String, uint8_t> subsampleOverrides;
 
     uint16_t currentAnimationShaderIndex = 0;
     LuaAnimation* currentAnimation;
+    // outgoing shader of a transition, draws on transitionFrame until the current one took over.
+    // blendFrame is the frame shown during a transition
+    LuaAnimation* transitionFrom = nullptr;
+    CRGB* transitionFrame = nullptr;
+    CRGB* blendFrame = nullptr;
+    Transition transition;
+    uint32_t transitionStartMicros = 0;
+    // old version of an edited or deleted shader, out of the cache and rendering until it is replaced
+    LuaAnimation* retired = nullptr;
     long lastUpdate = 0;
 
+    // real and scaled shader time, in micros to keep the fractions of slow speeds
+    uint32_t lastTickMicros = 0;
+    uint64_t shaderMicros = 0;
+    uint32_t nextFrameMicros = 0;
+    uint32_t fpsWindowStart = 0;
+    uint16_t fpsWindowFrames = 0;
+
+    // lastFrame is on the strip, an invariant frame is not rendered again until invalidated
+    bool frameShown = false;
+    bool invariantFrame = false;
+
     bool toReload = false;
+    // guards shaders and animations shared between the render task and web handlers
+    SemaphoreHandle_t lock;
+    // held by the output task while it reads the frame buffers
+    SemaphoreHandle_t outputLock;
+    TaskHandle_t renderTaskHandle = nullptr;
+    TaskHandle_t outputTaskHandle = nullptr;
+
+    // second state of the current shader rendering the upper half of the strip on the other core
+    LuaAnimation* twin = nullptr;
+    bool twinRejected = false;
+    size_t workerFrom = 0;
+    CallResult<void*> workerResult = CallResult<void*>(nullptr);
+    TaskHandle_t workerTaskHandle = nullptr;
+    SemaphoreHandle_t workerDone;
+    TaskHandle_t loaderTaskHandle = nullptr;
+    // latest selection still loading, swapped in by the render task at the start of a frame once ready
+    String selectedShader;
+    Transition selectedTransition;
+    bool selectQueued = false;
+    bool selectReady = false;
+    uint32_t selectStartMicros = 0;
+    RenderStats stats;
+    RenderSettings settings;
+    // of the last frame rendered on the render task
+    CallResult<void*> drawResult = CallResult<void*>(nullptr);
 
     SelectAnimationListener* listener;
-    void setCurrentAnimation(LuaAnimation* animation);
+    void setCurrentAnimation(LuaAnimation* animation, Transition transition = Transition());
+    void applyTransition();
+    void dropTransition();
+    void retireCurrent();
+    void releaseRetired();
+    void collectGarbage();
+    void invalidateFrame();
+    void detectInvariance();
+    void configure(LuaAnimation* animation);
+    void configureSharedRuntime();
+    void configurePost();
+    void applySettings();
+    static AnimationManager* lowMemoryManager;
+    static size_t onLowMemory(LuaAllocator *requester, size_t bytes);
+    // bytes asked for by failed allocations of the shared state since the last frame
+    volatile size_t sharedEvictionBytes = 0;
+    void evictShared();
+
+    void allocateBuffers();
+    void freeBuffers();
+    void startTasks();
+    void advanceTime();
+    uint16_t renderFps();
+    void keepDrawResult(CallResult<void*>& result);
+    bool interpolating();
+    void waitNextFrame(uint32_t& deadlineMicros, uint16_t fps);
+    void show();
+    void sendOutput();
+    void showInterpolated();
+    void countOutputFrame(uint32_t now);
+    static void renderTask(void *arg);
+    static void outputTask(void *arg);
+    static void workerTask(void *arg);
+    static void loaderTask(void *arg);
+    void queueSelect(String& shaderName, Transition transition, uint32_t startMicros);
+    bool loadSelected();
+    void swapSelected();
+    void preloadNeighbours();
+    void preload(String& shaderName, uint32_t generation);
+
+    CallResult<void*> applyCurrent();
+    bool prepareTwin();
+    void dropTwin();
+
+    // benchmarks run on the loader task, frames of a queued one and the result of the last one
+    int benchmarkFrames = 0;
+    CallResult<FxBenchmark> benchmarkResult = CallResult<FxBenchmark>(FxBenchmark(), 404, "No benchmark was run");
+    void runBenchmark();
+    CallResult<FxBenchmark> benchmarkFx(int frames, size_t pixels);
+    CallResult<uint32_t> benchmarkShader(const char* code, CRGB* scratch, size_t pixels, int frames);
 
+    CallResult<LuaAnimation*> loadAnimation(String& shaderName, LuaRuntime* runtime);
+    CallResult<void*> beginAnimation(LuaAnimation* animation);
+    CallResult<void*> loadDetached(String& shaderName, uint32_t generation);
+    CallResult<void*> selectNow(String& shaderName, Transition transition = Transition());
+    int findShader(const String& shaderName);
     CallResult<LuaAnimation*> loadCached(String& shaderName);
     CallResult<void*> reload();
 public:
     AnimationManager(ShaderStorage *storage, GlobalAnimationEnv* globalAnimationEnv);
 
-    template <uint8_t DATA_PIN>
-    CallResult<void*> connect(int size) {
-        CallResult<void*> loadResult = reload();
-        if (loadResult.hasError()) {
-            return loadResult;
-        }
-
-        this->size = size;
-        this->leds = new CRGB[size];
-        FastLED.addLeds<WS2812B, DATA_PIN, RGB>(leds, size).setCorrection(TypicalSMD5050);
-        FastLED.setBrightness(255);
-        FastLED.clear(true);
-        return CallResult<void*>(nullptr);
-    }
+    // outputs are mapped onto the frame one after another, the strip is as long as all of them
+    CallResult<void*> connect(std::vector<LedOutput>& outputs);
+    // swaps outputs at runtime, frame buffers are reallocated and shaders reloaded for the new length.
+    // 409 if a pin changes chipset, which takes a reboot
+    CallResult<void*> reconfigure(std::vector<LedOutput>& outputs);
+    std::vector<LedOutput>& getOutputs();
 
+    // step through the shader list, wrapping around at its ends
     void previous();
     void next();
     void faster();
     void slower();
     CallResult<void*> draw();
     void scheduleReload();
+    // called after a shader was stored or deleted, only that shader is reloaded while the strip goes on
+    void shaderChanged(String& shaderName);
+    void shaderRemoved(String& shaderName);
+    // a cached shader is current at once, others load on the loader task and 202 is returned,
+    // the listener hears of the switch once the shader renders
+    CallResult<void*> select(String& shaderName, Transition transition);
+    // with the transition of the settings
     CallResult<void*> select(String& shaderName);
     String getCurrent();
+    RenderStats& getStats();
+    // a copy of the result of the last frame, errors stay until a frame renders again
+    CallResult<void*> getDrawResult();
+    // a copy taken between frames
+    RenderSettings getSettings();
+    // replaces the settings between frames, values are expected in their ranges
+    void updateSettings(RenderSettings& updated);
+    size_t getShaderMemory(const String& shaderName);
+    // 0 clears the override, returns the factor the shader renders with or 0 if it is not loaded
+    uint8_t setSubsample(const String& shaderName, uint8_t factor);
+    // 202 once queued, 409 while one is queued or running
+    CallResult<void*> startFxBenchmark(int frames);
+    // 202 while running
+    CallResult<FxBenchmark> getFxBenchmark();
     void setListener(SelectAnimationListener* listener);
 
     virtual ~AnimationManager();
@@ -14,10 +14,26 @@ public:
     void onListShaders(AsyncWebServerRequest *request);
     void onGetShader(String& shader, AsyncWebServerRequest *request);
     void onDeleteShader(String& shader, AsyncWebServerRequest *request);
+    void onSetSubsample(String& shader, AsyncWebServerRequest *request);
 
     void onShow(String& shader, AsyncWebServerRequest *request);
     void onGetShow(AsyncWebServerRequest *request);
+    void onGetStats(AsyncWebServerRequest *request);
+    void onBenchmarkFx(AsyncWebServerRequest *request);
+    void onGetBenchmarkFx(AsyncWebServerRequest *request);
+    void onGetSettings(AsyncWebServerRequest *request);
+    void onSetSettings(AsyncWebServerRequest *request, JsonVariant &json);
+    void onGetOutputs(AsyncWebServerRequest *request);
+    void onSetOutputs(AsyncWebServerRequest *request, JsonVariant &json);
+
+    // outputs needing a reboot were saved, the device restarts from the main loop
+    bool isRestartRequested();
 private:
+    bool restartRequested = false;
+
+    template <typename T>
+    static bool readSetting(JsonVariant &json, const char* key, double min, double max, T& setting, String& error);
+    static bool readMemoryCap(JsonVariant &json, const char* key, size_t& setting, String& error);
     ShaderStorage* shaderStorage;
     AnimationManager *animationManager;
 };
@@ -0,0 +1,32 @@
+#ifndef GARLAND_FRAME_BUFFERS
+#define GARLAND_FRAME_BUFFERS
+
+#include <Arduino.h>
+#include <FastLED.h>
+#include <atomic>
+
+// Triple buffered frames handed from the render task to the output task without locks.
+// Each side owns one buffer, the third one changes hands with a single atomic exchange
+class FrameBuffers
+{
+public:
+    FrameBuffers(size_t size);
+    virtual ~FrameBuffers();
+
+    // writer side, copies the frame into the back buffer and makes it the latest one
+    void publish(const CRGB *frame);
+    // reader side, the latest published frame or nullptr if nothing was published since the last call
+    CRGB* acquire();
+    size_t getSize();
+private:
+    // marks a published buffer the reader did not take yet
+    static const int FRESH = 4;
+
+    CRGB *buffers[3];
+    size_t size;
+    int back = 0;
+    int front = 1;
+    std::atomic<int> middle;
+};
+
+#endif //GARLAND_FRAME_BUFFERS
@@ -6,7 +6,10 @@
 class GlobalAnimationEnv
 {
 public:
+    // shader time, runs at speed percent of real time
     uint32_t timeMillis = 0;
+    // shader time since the previous frame
+    uint32_t dtMillis = 0;
     uint32_t iteration = 0;
 };
 
@@ -0,0 +1,60 @@
+#ifndef GARLAND_LED_OUTPUTS
+#define GARLAND_LED_OUTPUTS
+
+#include <Arduino.h>
+#include <FastLED.h>
+#include <ArduinoJson.h>
+#include <vector>
+
+#include "CallResult.h"
+
+// one controller per rmt channel, all of them are clocked out at the same time
+#define LED_OUTPUTS_MAX 8
+// leds over all outputs, every led takes 33 bytes of frame buffers
+#define LED_TOTAL_MAX 2048
+
+enum LedChipset {
+    CHIPSET_WS2812B,
+    CHIPSET_WS2811,
+    CHIPSET_SK6812
+};
+
+// a strip on its own data pin, outputs are mapped one after another onto the frame
+class LedOutput
+{
+public:
+    LedOutput(uint8_t pin, uint16_t length, EOrder order = RGB, LedChipset chipset = CHIPSET_WS2812B);
+
+    uint8_t pin;
+    uint16_t length;
+    EOrder order;
+    LedChipset chipset;
+};
+
+// FastLED takes pin, chipset and color order as template arguments. Controllers are
+// instantiated for every usable pin and chipset with RGB order, the order is applied
+// natively by PostProcess when a frame is copied to the wire buffer
+class LedOutputs
+{
+public:
+    static CallResult<void*> validate(std::vector<LedOutput>& outputs);
+    static size_t totalLength(std::vector<LedOutput>& outputs);
+
+    // [{"pin": 32, "length": 50, "order": "RGB", "chipset": "WS2812B"}], order and chipset are optional
+    static CallResult<std::vector<LedOutput>> fromJson(JsonArrayConst json);
+    static void toJson(std::vector<LedOutput>& outputs, JsonArray json);
+
+    // registers one controller per output over consecutive ranges of wire. Controllers can not be
+    // removed from FastLED, ones of pins left out are kept with no leds
+    static CallResult<void*> addControllers(std::vector<LedOutput>& outputs, CRGB* wire);
+    // a pin once driven with one chipset can not take another one until reboot
+    static bool canAddControllers(std::vector<LedOutput>& outputs);
+
+    static bool isPinSupported(uint8_t pin);
+private:
+    static CLEDController* addController(uint8_t pin, LedChipset chipset, CRGB* data, int length);
+    static const char* orderName(EOrder order);
+    static const char* chipsetName(LedChipset chipset);
+};
+
+#endif //GARLAND_LED_OUTPUTS
@@ -0,0 +1,50 @@
+#ifndef GARLAND_LUA_ALLOCATOR
+#define GARLAND_LUA_ALLOCATOR
+
+#include <Arduino.h>
+#include <lua.hpp>
+
+class LuaAllocator;
+
+// small lua objects are served from shared size class pools carved out of fixed chunks,
+// bigger ones go to the heap
+#define LUA_POOL_CHUNK_SIZE 1024
+#define LUA_POOL_CLASSES 5
+#define LUA_POOL_MAX_BLOCK 64
+
+// called when the heap can not serve an allocation of the requesting state, returns bytes it freed.
+// The requesting state is in the middle of an allocation and must be left alone
+typedef size_t (*LowMemoryHandler)(LuaAllocator *requester, size_t bytes);
+
+// lua_Alloc with per state accounting, pass the instance as lua_newstate userdata
+class LuaAllocator
+{
+public:
+    static void* alloc(void *ud, void *ptr, size_t osize, size_t nsize);
+    static size_t getPoolBytes();
+    // a failed heap allocation is retried once after the handler freed memory
+    static void setLowMemoryHandler(LowMemoryHandler handler);
+
+    // 0 disables the cap, allocations above it fail with a lua memory error
+    void setCap(size_t cap);
+    size_t getCap();
+    size_t getUsedBytes();
+    size_t getPeakBytes();
+    uint32_t getAllocations();
+    uint32_t getFailures();
+private:
+    size_t cap = 0;
+    size_t usedBytes = 0;
+    size_t peakBytes = 0;
+    uint32_t allocations = 0;
+    uint32_t failures = 0;
+
+    static LowMemoryHandler lowMemoryHandler;
+
+    static void* reallocate(void *ptr, size_t oldSize, int oldClass, size_t nsize, int newClass);
+    static int sizeClass(size_t size);
+    static void* poolAlloc(int sizeClass);
+    static void poolFree(void *ptr, int sizeClass);
+};
+
+#endif //GARLAND_LUA_ALLOCATOR
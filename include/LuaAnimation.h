@@ -2,6 +2,7 @@
 #define GARLAND_LUA_ANIMATION
 
 #include <Arduino.h>
+#include <vector>
 #include <lua.hpp>
 #include <LuaBridge/LuaBridge.h>
 
@@ -11,21 +12,86 @@
 #include "GlobalAnimationEnv.h"
 #include "Animation.h"
 #include "LuaRefHolder.h"
+#include "LuaPixels.h"
+#include "LuaRuntime.h"
+
+// largest distance between pixels a color(i) shader is evaluated at
+#define SUBSAMPLE_MAX 16
 
 class LuaAnimation
 {
 public:
-    LuaAnimation(String& name);
+    // without a shared runtime the animation creates and owns a lua state of its own
+    LuaAnimation(String& name, LuaRuntime* sharedRuntime = nullptr);
     virtual ~LuaAnimation();
-    CallResult<void*> begin(String& shader, GlobalAnimationEnv* globalAnimationEnv);
+    CallResult<void*> begin(String& shader, std::vector<uint8_t>* bytecode, GlobalAnimationEnv* globalAnimationEnv);
     CallResult<void*> apply(CRGB *leds, size_t size);
+    // color(i) shaders render only leds from..to-1, frame shaders always render the whole strip
+    CallResult<void*> apply(CRGB *leds, size_t size, size_t from, size_t to);
+    // color(i) without frame(), may be split by pixel range
+    bool isPerPixel();
+    // color(i) is evaluated at every factor-th pixel and the rest interpolated,
+    // 0 goes back to subsample declared by the shader, 1 evaluates every pixel
+    void setSubsample(uint8_t factor);
+    uint8_t getSubsample();
+    // time_invariant = true in the shader, its frame only changes with the shader or settings
+    bool isTimeInvariant();
 
     String getName();
+    size_t getUsedBytes();
+    LuaAllocator& getAllocator();
+    size_t getPeakBytes();
+    void setMemoryCap(size_t cap);
+
+    // shared runtimes are configured by their owner
+    void configureGc(bool scheduled, int pause, int stepMul);
+    bool collectGarbage(uint32_t deadlineMicros, int stepKb, bool underPressure);
+
+    // 0 disables a limit, a shader overrunning its frame budget quarantineOverruns times in a row stops rendering
+    void configureBudget(uint32_t frameInstructions, uint32_t frameMicros, uint32_t loadInstructions, uint32_t loadMicros, uint8_t quarantineOverruns);
+    bool isQuarantined();
+    uint32_t getBudgetOverruns();
+    uint32_t getFrameAllocations();
+    uint32_t getLoadMicros();
+    bool isLoadedFromBytecode();
 private:
     String name;
 
+    LuaRuntime* runtime;
+    bool ownsRuntime;
     lua_State* luaState;
-    LuaRefHolder* luaRefHolder;
+    LuaRefHolder* environment = nullptr;
+    size_t sharedBytes = 0;
+
+    GlobalAnimationEnv* globalAnimationEnv;
+    LuaPixels* pixels;
+    LuaRefHolder* pixelsRef = nullptr;
+    LuaRefHolder* frameFunc = nullptr;
+    LuaRefHolder* colorFunc = nullptr;
+    bool rgbColors = false;
+    bool timeInvariant = false;
+    uint8_t shaderSubsample = 1;
+    uint8_t subsampleOverride = 0;
+    uint8_t subsample = 1;
+    uint32_t frameAllocations = 0;
+    uint32_t loadMicros = 0;
+    bool loadedFromBytecode = false;
+
+    uint32_t frameBudgetInstructions = 0;
+    uint32_t frameBudgetMicros = 0;
+    uint32_t loadBudgetInstructions = 0;
+    uint32_t loadBudgetMicros = 0;
+    uint8_t quarantineOverruns = 0;
+    uint8_t consecutiveOverruns = 0;
+    uint32_t budgetOverruns = 0;
+    bool quarantined = false;
+
+    LuaRefHolder* environmentFunction(const char* functionName);
+    CallResult<void*> applyFrame(CRGB *leds, size_t size);
+    CallResult<void*> applyColor(CRGB *leds, size_t size, size_t from, size_t to);
+    CallResult<bool> sampleColor(size_t i, uint8_t *color);
+    CRGB interpolate(uint8_t *from, uint8_t *to, size_t step, size_t steps);
+    CRGB toColor(uint8_t a, uint8_t b, uint8_t c);
 };
 
-#endif //GARLAND_LUA_ANIMATION
\ No newline at end of file
+#endif //GARLAND_LUA_ANIMATION
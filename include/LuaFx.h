@@ -0,0 +1,18 @@
+#ifndef GARLAND_LUA_FX
+#define GARLAND_LUA_FX
+
+#include <Arduino.h>
+#include <lua.hpp>
+#include <FastLED.h>
+
+#define LUA_FX_LIBNAME "fx"
+
+// FastLED lib8tion integer math for shaders, fx.sin8(theta) instead of float math.sin per pixel.
+// Arguments are truncated to the 8 or 16 bit width of the FastLED function like in C++
+class LuaFx
+{
+public:
+    static void registerLib(lua_State *L);
+};
+
+#endif //GARLAND_LUA_FX
@@ -0,0 +1,22 @@
+#ifndef GARLAND_LUA_PIXELS
+#define GARLAND_LUA_PIXELS
+
+#include <lua.hpp>
+#include <FastLED.h>
+
+#define LUA_PIXELS_TYPE "garland.pixels"
+
+// Userdata view of the frame buffer handed to frame(pixels, n, t) shaders.
+// Indices are 0-based like color(position), values are packed 0xRRGGBB.
+class LuaPixels
+{
+public:
+    CRGB *leds;
+    size_t size;
+
+    static void registerType(lua_State *L);
+    static LuaPixels* push(lua_State *L);
+    static LuaPixels* check(lua_State *L, int index);
+};
+
+#endif //GARLAND_LUA_PIXELS
@@ -0,0 +1,20 @@
+#ifndef GARLAND_LUA_PX
+#define GARLAND_LUA_PX
+
+#include <Arduino.h>
+#include <lua.hpp>
+#include <FastLED.h>
+
+#include "LuaPixels.h"
+
+#define LUA_PX_LIBNAME "px"
+
+// Native bulk kernels over the pixels userdata, px.fill(pixels, 0xFF0000) is one call instead of a lua loop.
+// Ranges are optional trailing from, count arguments, 0-based like pixels, defaulting to the whole strip
+class LuaPx
+{
+public:
+    static void registerLib(lua_State *L);
+};
+
+#endif //GARLAND_LUA_PX
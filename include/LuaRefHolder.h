@@ -1,13 +1,20 @@
 #ifndef LUA_REF_HOLDER
 #define LUA_REF_HOLDER
 
-#include <LuaBridge/LuaBridge.h>
+#include <lua.hpp>
 
+// Registry reference to a lua value, pushing it back costs a single rawgeti
 class LuaRefHolder
 {
 public:
-    luabridge::LuaRef ref;
-    LuaRefHolder(luabridge::LuaRef &luaRef) : ref(luaRef) {};
+    // Pops the value on top of the stack and keeps it in the registry
+    LuaRefHolder(lua_State *L) : L(L), ref(luaL_ref(L, LUA_REGISTRYINDEX)) {};
+    ~LuaRefHolder() { luaL_unref(L, LUA_REGISTRYINDEX, ref); };
+
+    void push() { lua_rawgeti(L, LUA_REGISTRYINDEX, ref); };
+private:
+    lua_State *L;
+    int ref;
 };
 
-#endif //LUA_REF_HOLDER
\ No newline at end of file
+#endif //LUA_REF_HOLDER
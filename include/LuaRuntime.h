@@ -0,0 +1,64 @@
+#ifndef GARLAND_LUA_RUNTIME
+#define GARLAND_LUA_RUNTIME
+
+#include <Arduino.h>
+#include <lua.hpp>
+#include <LuaBridge/LuaBridge.h>
+
+#include "CallResult.h"
+#include "GlobalAnimationEnv.h"
+#include "LuaAllocator.h"
+#include "LuaFx.h"
+#include "LuaPixels.h"
+#include "LuaPx.h"
+
+// how many lua instructions run between budget checks
+#define LUA_HOOK_INSTRUCTIONS 1000
+
+// lua_State with its allocator, libraries, collector schedule and execution budget,
+// owned by a single LuaAnimation or shared by many of them
+class LuaRuntime
+{
+public:
+    LuaRuntime();
+    virtual ~LuaRuntime();
+    CallResult<void*> begin(GlobalAnimationEnv* globalAnimationEnv);
+
+    lua_State* getState();
+    GlobalAnimationEnv* getEnv();
+    LuaAllocator& getAllocator();
+
+    // env of the runtime owning L, for lua c functions
+    static GlobalAnimationEnv* envOf(lua_State *L);
+
+    // scheduled collection stops the automatic collector and leaves it to collectGarbage
+    void configureGc(bool scheduled, int pause, int stepMul);
+    bool collectGarbage(uint32_t deadlineMicros, int stepKb, bool underPressure);
+
+    // the memory cap is only enforced while a budget is armed, unprotected api calls never hit it
+    void setMemoryCap(size_t cap);
+
+    // 0 disables a limit, lua code running over an armed budget raises an error
+    void armBudget(uint32_t instructions, uint32_t micros);
+    void disarmBudget();
+    bool isBudgetExceeded();
+private:
+    LuaAllocator allocator;
+    lua_State* luaState;
+    GlobalAnimationEnv* globalAnimationEnv = nullptr;
+    size_t memoryCap = 0;
+
+    int gcPause = 200;
+    bool gcCycleRunning = false;
+    size_t gcBaseBytes = 0;
+
+    uint32_t budgetInstructions = 0;
+    uint32_t budgetMicros = 0;
+    uint32_t budgetUsedInstructions = 0;
+    uint32_t budgetStart = 0;
+    bool budgetExceeded = false;
+
+    static void budgetHook(lua_State *L, lua_Debug *ar);
+};
+
+#endif //GARLAND_LUA_RUNTIME
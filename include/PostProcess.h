@@ -0,0 +1,64 @@
+#ifndef GARLAND_POST_PROCESS
+#define GARLAND_POST_PROCESS
+
+#include <Arduino.h>
+#include <FastLED.h>
+#include <vector>
+
+#include "LedOutputs.h"
+
+// gamma in tenths, 10 leaves shader colors linear
+#define GAMMA_MIN 10
+#define GAMMA_MAX 30
+
+// current of a single led at full channel and dark, typical ws2812b at 5v
+#define POWER_RED_MA 16
+#define POWER_GREEN_MA 11
+#define POWER_BLUE_MA 15
+#define POWER_IDLE_MA 1
+
+// Native stage between the shown frame and the wire: gamma, color correction and master
+// brightness folded into one lookup table per channel, brightness changes fade in over time.
+// The current a frame draws is estimated on the way and frames over budget are scaled down
+class PostProcess
+{
+public:
+    PostProcess();
+
+    // called from any task, the output task picks the change up on its next update
+    void configure(uint8_t brightness, uint8_t gamma, uint32_t correction, uint16_t fadeMillis);
+    // moves brightness towards its target and rebuilds the tables, true if they changed
+    bool update(uint32_t nowMillis);
+    bool isChanging();
+    // 0 is unlimited
+    void setPowerBudget(uint32_t milliamps);
+
+    // post processes frame into wire in the color order of each output
+    void toWire(std::vector<LedOutput>& outputs, const CRGB* frame, CRGB* wire);
+
+    // of the last frame, before and after limiting
+    uint32_t getRequestedMilliamps();
+    uint32_t getMilliamps();
+    uint32_t getLimitedFrames();
+private:
+    uint8_t lut[3][256];
+
+    volatile uint8_t targetBrightness = 255;
+    volatile uint8_t gamma = GAMMA_MIN;
+    volatile uint32_t correction = 0xFFFFFF;
+    volatile uint16_t fadeMillis = 0;
+    volatile bool dirty = true;
+
+    uint8_t brightness = 255;
+    uint32_t lastUpdateMillis = 0;
+
+    volatile uint32_t powerBudget = 0;
+    uint32_t requestedMilliamps = 0;
+    uint32_t milliamps = 0;
+    uint32_t limitedFrames = 0;
+
+    void buildTables();
+    void limitPower(CRGB* wire, size_t size, uint32_t* channelSums);
+};
+
+#endif //GARLAND_POST_PROCESS
@@ -0,0 +1,16 @@
+#ifndef GARLAND_RECURSIVE_LOCK
+#define GARLAND_RECURSIVE_LOCK
+
+#include <Arduino.h>
+
+// Holds a FreeRTOS recursive mutex until the end of the scope
+class RecursiveLock
+{
+public:
+    RecursiveLock(SemaphoreHandle_t mutex) : mutex(mutex) { xSemaphoreTakeRecursive(mutex, portMAX_DELAY); };
+    ~RecursiveLock() { xSemaphoreGiveRecursive(mutex); };
+private:
+    SemaphoreHandle_t mutex;
+};
+
+#endif //GARLAND_RECURSIVE_LOCK
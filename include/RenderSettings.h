@@ -0,0 +1,83 @@
+#ifndef GARLAND_RENDER_SETTINGS
+#define GARLAND_RENDER_SETTINGS
+
+#include <Arduino.h>
+#include <FastLED.h>
+
+#include "PostProcess.h"
+#include "Transition.h"
+
+#define SHADER_MEMORY_CAP (64 * 1024)
+#define SHARED_STATE_MEMORY_CAP (160 * 1024)
+#define GC_MIN_FREE_HEAP (16 * 1024)
+#define CACHE_MEMORY (96 * 1024)
+#define SPEED_STEP 10
+#define SPEED_MAX 400
+
+// accepted ranges of settings changed over the api, a memory cap is either 0 or at least MEMORY_CAP_MIN
+#define MEMORY_CAP_MIN (16 * 1024)
+#define GC_STEP_BUDGET_MAX 100000
+#define GC_STEP_KB_MAX 1024
+#define GC_PAUSE_MIN 50
+#define GC_PAUSE_MAX 1000
+#define GC_STEP_MUL_MIN 40
+#define GC_STEP_MUL_MAX 1000
+#define FPS_MAX 240
+#define FADE_MILLIS_MAX 10000
+
+class RenderSettings
+{
+public:
+    // lua heap bytes a single shader state may hold, 0 is unlimited
+    size_t shaderMemoryCap = SHADER_MEMORY_CAP;
+
+    // lua heap bytes loaded shaders may hold together before the least recently used ones are unloaded, 0 is unlimited
+    size_t cacheMemoryBytes = CACHE_MEMORY;
+    // load the shaders before and after the current one in the background, own states only
+    bool preload = true;
+
+    // host all shaders in one lua state with a globals table per shader, takes effect on reload
+    bool sharedState = false;
+    size_t sharedStateMemoryCap = SHARED_STATE_MEMORY_CAP;
+
+    // time given to the lua collector after each shown frame, 0 leaves collection to lua itself
+    uint32_t gcStepBudgetMicros = 2000;
+    int gcStepKb = 1;
+    int gcPause = 200;
+    int gcStepMul = 200;
+    // full collection once a shader holds this percent of its cap or the heap runs low
+    uint8_t gcPressurePercent = 90;
+
+    // limits of a single frame and of running the shader chunk on load, 0 is unlimited
+    uint32_t frameBudgetInstructions = 0;
+    uint32_t frameBudgetMicros = 200000;
+    uint32_t loadBudgetInstructions = 0;
+    uint32_t loadBudgetMicros = 1000000;
+    // overruns in a row after which a shader stops being rendered until reload
+    uint8_t quarantineOverruns = 3;
+
+    // frames rendered per second, the render task sleeps until the next frame is due, 0 renders as fast as possible
+    uint16_t targetFps = 60;
+    // shader frames per second blended up to targetFps on output, 0 or not below targetFps renders every frame
+    uint16_t keyframeFps = 0;
+    // percent of real time passed to shaders as env.millis and env.dt
+    uint16_t speed = 100;
+
+    // applied natively to every shown frame, gamma in tenths from GAMMA_MIN to GAMMA_MAX,
+    // correction is a 0xRRGGBB scale and brightness changes fade in over brightnessFadeMillis
+    uint8_t brightness = 255;
+    uint8_t gamma = GAMMA_MIN;
+    uint32_t correction = TypicalSMD5050;
+    uint16_t brightnessFadeMillis = 300;
+    // estimated current all outputs may draw, brighter frames are scaled down, 0 is unlimited
+    uint32_t powerBudgetMilliamps = 0;
+
+    // how a selection goes over to the new shader unless it names its own, 0 millis cuts
+    TransitionType transition = TRANSITION_CROSSFADE;
+    uint16_t transitionMillis = 0;
+
+    // evaluate color(i) shaders in two lua states, one half of the strip on each core
+    bool parallel = false;
+};
+
+#endif //GARLAND_RENDER_SETTINGS
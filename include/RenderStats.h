@@ -0,0 +1,41 @@
+#ifndef GARLAND_RENDER_STATS
+#define GARLAND_RENDER_STATS
+
+#include <Arduino.h>
+
+class RenderStats
+{
+public:
+    uint16_t renderFps = 0;
+    uint16_t outputFps = 0;
+    uint32_t renderMicros = 0;
+    uint32_t showMicros = 0;
+    // estimated current of the last shown frame as requested by the shader and after limiting
+    uint32_t requestedMilliamps = 0;
+    uint32_t milliamps = 0;
+    uint32_t powerLimitedFrames = 0;
+    bool parallel = false;
+    uint32_t skippedFrames = 0;
+    bool timeInvariant = false;
+    uint32_t frameAllocations = 0;
+    size_t luaBytes = 0;
+    size_t luaPoolBytes = 0;
+    size_t sharedStateBytes = 0;
+    uint32_t gcMicros = 0;
+    uint32_t gcFullCollections = 0;
+    uint32_t budgetOverruns = 0;
+    bool quarantined = false;
+    bool transitioning = false;
+    size_t cacheBytes = 0;
+    uint32_t cacheHits = 0;
+    uint32_t cacheMisses = 0;
+    uint32_t cacheEvictions = 0;
+    uint32_t lowMemoryEvictions = 0;
+    uint32_t loadMicros = 0;
+    // from select to the shader rendering next frame, short when it was cached or preloaded
+    uint32_t switchMicros = 0;
+    uint32_t preloads = 0;
+    bool loadedFromBytecode = false;
+};
+
+#endif //GARLAND_RENDER_STATS
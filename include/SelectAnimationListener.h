@@ -7,6 +7,7 @@ class SelectAnimationListener
 {
 public:
     virtual void animationSelected(String name) = 0;
+    virtual void animationSelectFailed(String name, String message) = 0;
 };
 
 
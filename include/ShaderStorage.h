@@ -7,13 +7,21 @@
 #include "CallResult.h"
 #include "EditAnimationListener.h"
 
+class ShaderCompileStats {
+public:
+    uint32_t sourceLoadMicros = 0;
+    uint32_t bytecodeLoadMicros = 0;
+    size_t bytecodeSize = 0;
+};
+
 class ShaderStorage {
 public:
     ShaderStorage();
     virtual ~ShaderStorage();
-    CallResult<void*> storeShader(const String& name, const String& code);
+    CallResult<ShaderCompileStats> storeShader(const String& name, const String& code);
     bool hasShader(const String& name) const;
     CallResult<String> getShader(const String& name) const;
+    CallResult<std::vector<uint8_t>*> getBytecode(const String& name, const String& code) const;
     bool deleteShader(const String& name);
     CallResult<std::vector<String>*> listShaders() const;
 
@@ -22,18 +30,27 @@ public:
     void saveLastShader(const String& lastShader);
     String getLastShader() const;
 
+    // led outputs as json, empty until configured over the api
+    void saveOutputs(const String& outputs);
+    String getOutputs() const;
+
 private:
     bool begin();
     String shaderFolderFile(const String& name) const;
+    String bytecodeFolderFile(const String& name) const;
+    CallResult<ShaderCompileStats> compileShader(const String& name, const String& code);
 
     void saveProperty(const String& name, const String& value);
     String getProperty(const String& name) const;
 
     CallResult<void*> writeFile(const String& name, const String& value);
     CallResult<String> readFile(const String& name) const;
+    CallResult<void*> writeBinaryFile(const String& name, const std::vector<uint8_t>& value);
+    CallResult<std::vector<uint8_t>*> readBinaryFile(const String& name) const;
 
     EditAnimationListener *listener;
     const String shaderDirectory = "/sh";
+    const String bytecodeDirectory = "/shc";
     const String propertiesDirectory = "/props";
 };
 
@@ -24,6 +24,7 @@ public:
     void textAll(String text);
 
     void animationSelected(String name);
+    void animationSelectFailed(String name, String message);
     void animationAdded(String name);
     void animationRemoved(String name);
 };
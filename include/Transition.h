@@ -0,0 +1,36 @@
+#ifndef GARLAND_TRANSITION
+#define GARLAND_TRANSITION
+
+#include <Arduino.h>
+#include <FastLED.h>
+
+#include "CallResult.h"
+
+#define TRANSITION_MAX_MILLIS 10000
+
+enum TransitionType {
+    TRANSITION_CUT,
+    TRANSITION_CROSSFADE,
+    TRANSITION_WIPE,
+    TRANSITION_DISSOLVE
+};
+
+// How the strip goes over from one shader to the next. Both shaders keep rendering
+// for the duration and their frames are blended natively
+class Transition
+{
+public:
+    Transition(TransitionType type = TRANSITION_CUT, uint16_t durationMillis = 0);
+
+    TransitionType type;
+    uint16_t durationMillis;
+
+    bool isCut();
+    // blends the outgoing and the incoming frame into blended, progress runs from 0 to 255
+    void apply(const CRGB* outgoing, const CRGB* incoming, CRGB* blended, size_t size, uint8_t progress);
+
+    static CallResult<TransitionType> typeFromName(const String& name);
+    static const char* typeName(TransitionType type);
+};
+
+#endif //GARLAND_TRANSITION
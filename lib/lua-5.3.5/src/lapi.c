@@ -22,6 +22,7 @@
 #include "lgc.h"
 #include "lmem.h"
 #include "lobject.h"
+#include "lrotable.h"
 #include "lstate.h"
 #include "lstring.h"
 #include "ltable.h"
@@ -250,6 +251,10 @@ LUA_API void lua_pushvalue (lua_State *L, int idx) {
 
 LUA_API int lua_type (lua_State *L, int idx) {
   StkId o = index2addr(L, idx);
+#if defined(LUA_USE_ROTABLES)
+  if (ttisrotable(o))  /* read-only tables are tables to the API */
+    return LUA_TTABLE;
+#endif
   return (isvalid(o) ? ttnov(o) : LUA_TNONE);
 }
 
@@ -286,6 +291,13 @@ LUA_API int lua_isstring (lua_State *L, int idx) {
 }
 
 
+#if defined(LUA_USE_ROTABLES)
+LUA_API int lua_isrotable (lua_State *L, int idx) {
+  return ttisrotable(index2addr(L, idx));
+}
+#endif
+
+
 LUA_API int lua_isuserdata (lua_State *L, int idx) {
   const TValue *o = index2addr(L, idx);
   return (ttisfulluserdata(o) || ttislightuserdata(o));
@@ -436,6 +448,9 @@ LUA_API const void *lua_topointer (lua_State *L, int idx) {
     case LUA_TTHREAD: return thvalue(o);
     case LUA_TUSERDATA: return getudatamem(uvalue(o));
     case LUA_TLIGHTUSERDATA: return pvalue(o);
+#if defined(LUA_USE_ROTABLES)
+    case LUA_TROTABLE: return rotvalue(o);
+#endif
     default: return NULL;
   }
 }
@@ -554,6 +569,16 @@ LUA_API void lua_pushcclosure (lua_State *L, lua_CFunction fn, int n) {
 }
 
 
+#if defined(LUA_USE_ROTABLES)
+LUA_API void lua_pushrotable (lua_State *L, const luaR_table *t) {
+  lua_lock(L);
+  setrotvalue(L->top, t);
+  api_incr_top(L);
+  lua_unlock(L);
+}
+#endif
+
+
 LUA_API void lua_pushboolean (lua_State *L, int b) {
   lua_lock(L);
   setbvalue(L->top, (b != 0));  /* ensure that true is 1 */
@@ -648,8 +673,15 @@ LUA_API int lua_rawget (lua_State *L, int idx) {
   StkId t;
   lua_lock(L);
   t = index2addr(L, idx);
-  api_check(L, ttistable(t), "table expected");
-  setobj2s(L, L->top - 1, luaH_get(hvalue(t), L->top - 1));
+#if defined(LUA_USE_ROTABLES)
+  if (ttisrotable(t))
+    luaR_get(L, rotvalue(t), L->top - 1, L->top - 1);
+  else
+#endif
+  {
+    api_check(L, ttistable(t), "table expected");
+    setobj2s(L, L->top - 1, luaH_get(hvalue(t), L->top - 1));
+  }
   lua_unlock(L);
   return ttnov(L->top - 1);
 }
@@ -659,8 +691,15 @@ LUA_API int lua_rawgeti (lua_State *L, int idx, lua_Integer n) {
   StkId t;
   lua_lock(L);
   t = index2addr(L, idx);
-  api_check(L, ttistable(t), "table expected");
-  setobj2s(L, L->top, luaH_getint(hvalue(t), n));
+#if defined(LUA_USE_ROTABLES)
+  if (ttisrotable(t))  /* library tables have no integer keys */
+    setnilvalue(L->top);
+  else
+#endif
+  {
+    api_check(L, ttistable(t), "table expected");
+    setobj2s(L, L->top, luaH_getint(hvalue(t), n));
+  }
   api_incr_top(L);
   lua_unlock(L);
   return ttnov(L->top - 1);
@@ -672,9 +711,16 @@ LUA_API int lua_rawgetp (lua_State *L, int idx, const void *p) {
   TValue k;
   lua_lock(L);
   t = index2addr(L, idx);
-  api_check(L, ttistable(t), "table expected");
-  setpvalue(&k, cast(void *, p));
-  setobj2s(L, L->top, luaH_get(hvalue(t), &k));
+#if defined(LUA_USE_ROTABLES)
+  if (ttisrotable(t))  /* nor pointer keys */
+    setnilvalue(L->top);
+  else
+#endif
+  {
+    api_check(L, ttistable(t), "table expected");
+    setpvalue(&k, cast(void *, p));
+    setobj2s(L, L->top, luaH_get(hvalue(t), &k));
+  }
   api_incr_top(L);
   lua_unlock(L);
   return ttnov(L->top - 1);
@@ -700,6 +746,12 @@ LUA_API int lua_getmetatable (lua_State *L, int objindex) {
   int res = 0;
   lua_lock(L);
   obj = index2addr(L, objindex);
+#if defined(LUA_USE_ROTABLES)
+  if (ttisrotable(obj)) {  /* read-only tables have no metatable */
+    lua_unlock(L);
+    return 0;
+  }
+#endif
   switch (ttnov(obj)) {
     case LUA_TTABLE:
       mt = hvalue(obj)->metatable;
@@ -798,12 +850,21 @@ LUA_API void lua_seti (lua_State *L, int idx, lua_Integer n) {
 }
 
 
+#if defined(LUA_USE_ROTABLES)
+#define checkwritable(L,o)  \
+  { if (ttisrotable(o)) luaG_runerror(L, "attempt to modify read-only table"); }
+#else
+#define checkwritable(L,o)	((void)0)
+#endif
+
+
 LUA_API void lua_rawset (lua_State *L, int idx) {
   StkId o;
   TValue *slot;
   lua_lock(L);
   api_checknelems(L, 2);
   o = index2addr(L, idx);
+  checkwritable(L, o);
   api_check(L, ttistable(o), "table expected");
   slot = luaH_set(L, hvalue(o), L->top - 2);
   setobj2t(L, slot, L->top - 1);
@@ -819,6 +880,7 @@ LUA_API void lua_rawseti (lua_State *L, int idx, lua_Integer n) {
   lua_lock(L);
   api_checknelems(L, 1);
   o = index2addr(L, idx);
+  checkwritable(L, o);
   api_check(L, ttistable(o), "table expected");
   luaH_setint(L, hvalue(o), n, L->top - 1);
   luaC_barrierback(L, hvalue(o), L->top-1);
@@ -833,6 +895,7 @@ LUA_API void lua_rawsetp (lua_State *L, int idx, const void *p) {
   lua_lock(L);
   api_checknelems(L, 1);
   o = index2addr(L, idx);
+  checkwritable(L, o);
   api_check(L, ttistable(o), "table expected");
   setpvalue(&k, cast(void *, p));
   slot = luaH_set(L, hvalue(o), &k);
@@ -849,9 +912,14 @@ LUA_API int lua_setmetatable (lua_State *L, int objindex) {
   lua_lock(L);
   api_checknelems(L, 1);
   obj = index2addr(L, objindex);
+  checkwritable(L, obj);
   if (ttisnil(L->top - 1))
     mt = NULL;
   else {
+#if defined(LUA_USE_ROTABLES)
+    if (ttisrotable(L->top - 1))
+      luaG_runerror(L, "read-only table can not be a metatable");
+#endif
     api_check(L, ttistable(L->top - 1), "table expected");
     mt = hvalue(L->top - 1);
   }
@@ -1125,8 +1193,15 @@ LUA_API int lua_next (lua_State *L, int idx) {
   int more;
   lua_lock(L);
   t = index2addr(L, idx);
-  api_check(L, ttistable(t), "table expected");
-  more = luaH_next(L, hvalue(t), L->top - 1);
+#if defined(LUA_USE_ROTABLES)
+  if (ttisrotable(t))
+    more = luaR_next(L, rotvalue(t), L->top - 1);
+  else
+#endif
+  {
+    api_check(L, ttistable(t), "table expected");
+    more = luaH_next(L, hvalue(t), L->top - 1);
+  }
   if (more) {
     api_incr_top(L);
   }
@@ -16,6 +16,7 @@
 
 #include "lauxlib.h"
 #include "lualib.h"
+#include "lrotable.h"
 
 
 static lua_State *getco (lua_State *L) {
@@ -161,8 +162,16 @@ static const luaL_Reg co_funcs[] = {
 
 
 
+#if defined(LUA_USE_ROTABLES)
+static const luaR_table corot = {LUA_COLIBNAME, co_funcs, NULL};
+#endif
+
 LUAMOD_API int luaopen_coroutine (lua_State *L) {
+#if defined(LUA_USE_ROTABLES)
+  lua_pushrotable(L, &corot);
+#else
   luaL_newlib(L, co_funcs);
+#endif
   return 1;
 }
 
@@ -18,6 +18,7 @@
 
 #include "lauxlib.h"
 #include "lualib.h"
+#include "lrotable.h"
 
 
 /*
@@ -449,8 +450,16 @@ static const luaL_Reg dblib[] = {
 };
 
 
+#if defined(LUA_USE_ROTABLES)
+static const luaR_table dbrot = {LUA_DBLIBNAME, dblib, NULL};
+#endif
+
 LUAMOD_API int luaopen_debug (lua_State *L) {
+#if defined(LUA_USE_ROTABLES)
+  lua_pushrotable(L, &dbrot);
+#else
   luaL_newlib(L, dblib);
+#endif
   return 1;
 }
 
@@ -17,6 +17,7 @@
 
 #include "lauxlib.h"
 #include "lualib.h"
+#include "lrotable.h"
 
 
 #undef PI
@@ -395,7 +396,23 @@ static const luaL_Reg mathlib[] = {
 /*
 ** Open math library
 */
+#if defined(LUA_USE_ROTABLES)
+static const luaR_const mathconsts[] = {
+  LROT_FLOAT("pi", PI),
+  LROT_FLOAT("huge", (lua_Number)HUGE_VAL),
+  LROT_INT("maxinteger", LUA_MAXINTEGER),
+  LROT_INT("mininteger", LUA_MININTEGER),
+  LROT_END
+};
+
+static const luaR_table mathrot = {LUA_MATHLIBNAME, mathlib, mathconsts};
+#endif
+
 LUAMOD_API int luaopen_math (lua_State *L) {
+#if defined(LUA_USE_ROTABLES)
+  lua_pushrotable(L, &mathrot);
+  return 1;
+#endif
   luaL_newlib(L, mathlib);
   lua_pushnumber(L, PI);
   lua_setfield(L, -2, "pi");
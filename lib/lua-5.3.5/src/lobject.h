@@ -59,6 +59,10 @@
 #define LUA_TNUMINT	(LUA_TNUMBER | (1 << 4))  /* integer numbers */
 
 
+/* Variant tags for light userdata */
+#define LUA_TROTABLE	(LUA_TLIGHTUSERDATA | (1 << 4))  /* read-only table */
+
+
 /* Bit mark for collectable types */
 #define BIT_ISCOLLECTABLE	(1 << 6)
 
@@ -157,6 +161,7 @@ typedef struct lua_TValue {
 #define ttisfulluserdata(o)	checktag((o), ctb(LUA_TUSERDATA))
 #define ttisthread(o)		checktag((o), ctb(LUA_TTHREAD))
 #define ttisdeadkey(o)		checktag((o), LUA_TDEADKEY)
+#define ttisrotable(o)		checktag((o), LUA_TROTABLE)
 
 
 /* Macros to access values */
@@ -175,6 +180,8 @@ typedef struct lua_TValue {
 #define hvalue(o)	check_exp(ttistable(o), gco2t(val_(o).gc))
 #define bvalue(o)	check_exp(ttisboolean(o), val_(o).b)
 #define thvalue(o)	check_exp(ttisthread(o), gco2th(val_(o).gc))
+#define rotvalue(o)	check_exp(ttisrotable(o), \
+	cast(const struct luaR_table *, val_(o).p))
 /* a dead value may get the 'gc' field, but cannot access its contents */
 #define deadvalue(o)	check_exp(ttisdeadkey(o), cast(void *, val_(o).gc))
 
@@ -215,6 +222,9 @@ typedef struct lua_TValue {
 #define setpvalue(obj,x) \
   { TValue *io=(obj); val_(io).p=(x); settt_(io, LUA_TLIGHTUSERDATA); }
 
+#define setrotvalue(obj,x) \
+  { TValue *io=(obj); val_(io).p=cast(void *, x); settt_(io, LUA_TROTABLE); }
+
 #define setbvalue(obj,x) \
   { TValue *io=(obj); val_(io).b=(x); settt_(io, LUA_TBOOLEAN); }
 
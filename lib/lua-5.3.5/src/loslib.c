@@ -20,6 +20,7 @@
 
 #include "lauxlib.h"
 #include "lualib.h"
+#include "lrotable.h"
 
 
 /*
@@ -395,8 +396,16 @@ static const luaL_Reg syslib[] = {
 
 
 
+#if defined(LUA_USE_ROTABLES)
+static const luaR_table osrot = {LUA_OSLIBNAME, syslib, NULL};
+#endif
+
 LUAMOD_API int luaopen_os (lua_State *L) {
+#if defined(LUA_USE_ROTABLES)
+  lua_pushrotable(L, &osrot);
+#else
   luaL_newlib(L, syslib);
+#endif
   return 1;
 }
 
@@ -0,0 +1,152 @@
+/*
+** Read-only library tables kept in flash (ROM) instead of the Lua heap
+** See Copyright Notice in lua.h
+*/
+
+#define lrotable_c
+#define LUA_CORE
+
+#include "lprefix.h"
+
+
+#include "lua.h"
+
+#include "ldebug.h"
+#include "lobject.h"
+#include "lrotable.h"
+#include "lstate.h"
+#include "lstring.h"
+
+
+#if defined(LUA_USE_ROTABLES)
+
+
+/*
+** Compare a (possibly not zero-terminated) key of length 'l' with a
+** zero-terminated entry name, never reading past the end of the name.
+*/
+static int samename (const char *name, const char *s, size_t l) {
+  size_t i;
+  for (i = 0; i < l; i++) {
+    if (name[i] != s[i] || name[i] == '\0')
+      return 0;
+  }
+  return name[l] == '\0';
+}
+
+
+static void pushconst (lua_State *L, const luaR_const *c, StkId val) {
+  switch (c->type) {
+    case LUA_ROT_INT: setivalue(val, c->i); break;
+    case LUA_ROT_FLOAT: setfltvalue(val, c->n); break;
+    default: setsvalue2s(L, val, luaS_newlstr(L, c->s, c->i)); break;
+  }
+}
+
+
+/*
+** Linear search over the function entries and then the constants; the
+** result is remembered in the state's cache, keyed by the string hash.
+** Colliding keys share a slot, so a hit is verified by name.
+*/
+void luaR_get (lua_State *L, const luaR_table *t, const TValue *key,
+               StkId val) {
+  luaR_cacheentry *ce;
+  const char *s;
+  size_t l;
+  const luaL_Reg *f;
+  const luaR_const *c;
+  if (!ttisshrstring(key)) {  /* library keys are all short strings */
+    setnilvalue(val);
+    return;
+  }
+  s = getstr(tsvalue(key));
+  l = tsvalue(key)->shrlen;
+  ce = &G(L)->rotcache[lmod(tsvalue(key)->hash ^ point2uint(t),
+                            LUAR_CACHE_SIZE)];
+  if (ce->t == t) {
+    if (ce->isconst) {
+      c = cast(const luaR_const *, ce->hit);
+      if (samename(c->name, s, l)) {
+        pushconst(L, c, val);
+        return;
+      }
+    }
+    else {
+      f = cast(const luaL_Reg *, ce->hit);
+      if (samename(f->name, s, l)) {
+        setfvalue(val, f->func);
+        return;
+      }
+    }
+  }
+  for (f = t->funcs; f != NULL && f->name != NULL; f++) {
+    if (f->func != NULL && samename(f->name, s, l)) {
+      ce->t = t;
+      ce->hit = f;
+      ce->isconst = 0;
+      setfvalue(val, f->func);
+      return;
+    }
+  }
+  for (c = t->consts; c != NULL && c->name != NULL; c++) {
+    if (samename(c->name, s, l)) {
+      ce->t = t;
+      ce->hit = c;
+      ce->isconst = 1;
+      pushconst(L, c, val);
+      return;
+    }
+  }
+  setnilvalue(val);
+}
+
+
+/*
+** Iteration order is the function entries followed by the constants.
+** 'key' holds the previous key (nil to start); on success the next key
+** and its value are stored at 'key' and 'key + 1'.
+*/
+int luaR_next (lua_State *L, const luaR_table *t, StkId key) {
+  const luaL_Reg *f = t->funcs;
+  const luaR_const *c = t->consts;
+  if (!ttisnil(key)) {  /* find the previous key */
+    const char *s;
+    size_t l;
+    if (!ttisstring(key))
+      luaG_runerror(L, "invalid key to 'next'");
+    s = getstr(tsvalue(key));
+    l = tsslen(tsvalue(key));
+    for (; f != NULL && f->name != NULL; f++) {
+      if (f->func != NULL && samename(f->name, s, l)) {
+        f++;
+        goto nextfunc;
+      }
+    }
+    for (; c != NULL && c->name != NULL; c++) {
+      if (samename(c->name, s, l)) {
+        c++;
+        goto nextconst;
+      }
+    }
+    luaG_runerror(L, "invalid key to 'next'");
+  }
+ nextfunc:
+  for (; f != NULL && f->name != NULL; f++) {
+    if (f->func != NULL) {
+      setsvalue2s(L, key, luaS_new(L, f->name));
+      setfvalue(key + 1, f->func);
+      return 1;
+    }
+  }
+ nextconst:
+  if (c != NULL && c->name != NULL) {
+    setsvalue2s(L, key, luaS_new(L, c->name));
+    pushconst(L, c, key + 1);
+    return 1;
+  }
+  return 0;
+}
+
+
+#endif
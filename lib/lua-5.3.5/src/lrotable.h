@@ -0,0 +1,69 @@
+/*
+** Read-only library tables kept in flash (ROM) instead of the Lua heap
+** See Copyright Notice in lua.h
+*/
+
+#ifndef lrotable_h
+#define lrotable_h
+
+#include "lua.h"
+#include "lauxlib.h"
+
+
+#if defined(LUA_USE_ROTABLES)
+
+/* types of non-function entries */
+#define LUA_ROT_INT	0
+#define LUA_ROT_FLOAT	1
+#define LUA_ROT_STRING	2
+
+typedef struct luaR_const {
+  const char *name;
+  int type;
+  lua_Integer i;  /* value, or length of 's' */
+  lua_Number n;
+  const char *s;
+} luaR_const;
+
+#define LROT_INT(name,v)	{(name), LUA_ROT_INT, (v), 0, NULL}
+#define LROT_FLOAT(name,v)	{(name), LUA_ROT_FLOAT, 0, (v), NULL}
+#define LROT_STR(name,v)	{(name), LUA_ROT_STRING, sizeof(v) - 1, 0, (v)}
+#define LROT_END		{NULL, 0, 0, 0, NULL}
+
+/*
+** A library table: the library's own 'luaL_Reg' array (entries with a
+** NULL function are placeholders and skipped) plus optional constants.
+** Both arrays are 'const', so the whole table stays in flash.
+*/
+typedef struct luaR_table {
+  const char *name;
+  const luaL_Reg *funcs;
+  const luaR_const *consts;
+} luaR_table;
+
+LUA_API void (lua_pushrotable) (lua_State *L, const luaR_table *t);
+LUA_API int (lua_isrotable) (lua_State *L, int idx);
+
+
+#if defined(LUA_CORE)
+
+#include "lobject.h"
+
+/* direct-mapped lookup cache, one per state */
+#define LUAR_CACHE_SIZE	32
+
+typedef struct luaR_cacheentry {
+  const luaR_table *t;
+  const void *hit;  /* 'luaL_Reg' or 'luaR_const' entry of 't' */
+  int isconst;
+} luaR_cacheentry;
+
+LUAI_FUNC void luaR_get (lua_State *L, const luaR_table *t,
+                         const TValue *key, StkId val);
+LUAI_FUNC int luaR_next (lua_State *L, const luaR_table *t, StkId key);
+
+#endif
+
+#endif
+
+#endif
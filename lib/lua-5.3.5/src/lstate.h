@@ -10,6 +10,7 @@
 #include "lua.h"
 
 #include "lobject.h"
+#include "lrotable.h"
 #include "ltm.h"
 #include "lzio.h"
 
@@ -169,6 +170,9 @@ typedef struct global_State {
   TString *tmname[TM_N];  /* array with tag-method names */
   struct Table *mt[LUA_NUMTAGS];  /* metatables for basic types */
   TString *strcache[STRCACHE_N][STRCACHE_M];  /* cache for strings in API */
+#if defined(LUA_USE_ROTABLES)
+  luaR_cacheentry rotcache[LUAR_CACHE_SIZE];  /* cache for rotable lookups */
+#endif
 } global_State;
 
 
@@ -23,6 +23,7 @@
 
 #include "lauxlib.h"
 #include "lualib.h"
+#include "lrotable.h"
 
 
 /*
@@ -1576,8 +1577,16 @@ static void createmetatable (lua_State *L) {
 /*
 ** Open string library
 */
+#if defined(LUA_USE_ROTABLES)
+static const luaR_table strrot = {LUA_STRLIBNAME, strlib, NULL};
+#endif
+
 LUAMOD_API int luaopen_string (lua_State *L) {
+#if defined(LUA_USE_ROTABLES)
+  lua_pushrotable(L, &strrot);
+#else
   luaL_newlib(L, strlib);
+#endif
   createmetatable(L);
   return 1;
 }
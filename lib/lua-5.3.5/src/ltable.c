@@ -128,6 +128,10 @@ static Node *mainposition (const Table *t, const TValue *key) {
       return hashboolean(t, bvalue(key));
     case LUA_TLIGHTUSERDATA:
       return hashpointer(t, pvalue(key));
+#if defined(LUA_USE_ROTABLES)
+    case LUA_TROTABLE:
+      return hashpointer(t, rotvalue(key));
+#endif
     case LUA_TLCF:
       return hashpointer(t, fvalue(key));
     default:
@@ -18,6 +18,7 @@
 
 #include "lauxlib.h"
 #include "lualib.h"
+#include "lrotable.h"
 
 
 /*
@@ -438,8 +439,16 @@ static const luaL_Reg tab_funcs[] = {
 };
 
 
+#if defined(LUA_USE_ROTABLES)
+static const luaR_table tabrot = {LUA_TABLIBNAME, tab_funcs, NULL};
+#endif
+
 LUAMOD_API int luaopen_table (lua_State *L) {
+#if defined(LUA_USE_ROTABLES)
+  lua_pushrotable(L, &tabrot);
+#else
   luaL_newlib(L, tab_funcs);
+#endif
 #if defined(LUA_COMPAT_UNPACK)
   /* _G.unpack = table.unpack */
   lua_getfield(L, -1, "unpack");
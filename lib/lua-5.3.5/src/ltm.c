@@ -95,6 +95,10 @@ const char *luaT_objtypename (lua_State *L, const TValue *o) {
     if (ttisstring(name))  /* is '__name' a string? */
       return getstr(tsvalue(name));  /* use it as type name */
   }
+#if defined(LUA_USE_ROTABLES)
+  if (ttisrotable(o))
+    return "table";
+#endif
   return ttypename(ttnov(o));  /* else use standard type name */
 }
 
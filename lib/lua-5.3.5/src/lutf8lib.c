@@ -19,6 +19,7 @@
 
 #include "lauxlib.h"
 #include "lualib.h"
+#include "lrotable.h"
 
 #define MAXUNICODE	0x10FFFF
 
@@ -247,7 +248,20 @@ static const luaL_Reg funcs[] = {
 };
 
 
+#if defined(LUA_USE_ROTABLES)
+static const luaR_const consts[] = {
+  LROT_STR("charpattern", UTF8PATT),
+  LROT_END
+};
+
+static const luaR_table utf8rot = {LUA_UTF8LIBNAME, funcs, consts};
+#endif
+
 LUAMOD_API int luaopen_utf8 (lua_State *L) {
+#if defined(LUA_USE_ROTABLES)
+  lua_pushrotable(L, &utf8rot);
+  return 1;
+#endif
   luaL_newlib(L, funcs);
   lua_pushlstring(L, UTF8PATT, sizeof(UTF8PATT)/sizeof(char) - 1);
   lua_setfield(L, -2, "charpattern");
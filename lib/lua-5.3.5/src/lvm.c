@@ -24,6 +24,7 @@
 #include "lgc.h"
 #include "lobject.h"
 #include "lopcodes.h"
+#include "lrotable.h"
 #include "lstate.h"
 #include "lstring.h"
 #include "ltable.h"
@@ -164,6 +165,12 @@ void luaV_finishget (lua_State *L, const TValue *t, TValue *key, StkId val,
   for (loop = 0; loop < MAXTAGLOOP; loop++) {
     if (slot == NULL) {  /* 't' is not a table? */
       lua_assert(!ttistable(t));
+#if defined(LUA_USE_ROTABLES)
+      if (ttisrotable(t)) {  /* read-only table has no metatable */
+        luaR_get(L, rotvalue(t), key, val);
+        return;
+      }
+#endif
       tm = luaT_gettmbyobj(L, t, TM_INDEX);
       if (ttisnil(tm))
         luaG_typeerror(L, t, "index");  /* no metamethod */
@@ -221,6 +228,10 @@ void luaV_finishset (lua_State *L, const TValue *t, TValue *key,
       /* else will try the metamethod */
     }
     else {  /* not a table; check metamethod */
+#if defined(LUA_USE_ROTABLES)
+      if (ttisrotable(t))
+        luaG_runerror(L, "attempt to modify read-only table");
+#endif
       if (ttisnil(tm = luaT_gettmbyobj(L, t, TM_NEWINDEX)))
         luaG_typeerror(L, t, "index");
     }
@@ -421,6 +432,9 @@ int luaV_equalobj (lua_State *L, const TValue *t1, const TValue *t2) {
     case LUA_TNUMFLT: return luai_numeq(fltvalue(t1), fltvalue(t2));
     case LUA_TBOOLEAN: return bvalue(t1) == bvalue(t2);  /* true must be 1 !! */
     case LUA_TLIGHTUSERDATA: return pvalue(t1) == pvalue(t2);
+#if defined(LUA_USE_ROTABLES)
+    case LUA_TROTABLE: return rotvalue(t1) == rotvalue(t2);
+#endif
     case LUA_TLCF: return fvalue(t1) == fvalue(t2);
     case LUA_TSHRSTR: return eqshrstr(tsvalue(t1), tsvalue(t2));
     case LUA_TLNGSTR: return luaS_eqlngstr(tsvalue(t1), tsvalue(t2));
@@ -532,6 +546,12 @@ void luaV_objlen (lua_State *L, StkId ra, const TValue *rb) {
       setivalue(ra, tsvalue(rb)->u.lnglen);
       return;
     }
+#if defined(LUA_USE_ROTABLES)
+    case LUA_TROTABLE: {  /* no array part, like a table of named fields */
+      setivalue(ra, 0);
+      return;
+    }
+#endif
     default: {  /* try metamethod */
       tm = luaT_gettmbyobj(L, rb, TM_LEN);
       if (ttisnil(tm))  /* no metamethod? */
@@ -0,0 +1,145 @@
+#include "AnimationCache.h"
+
+size_t StringHash::operator()(const String& value) const {
+    uint32_t hash = 2166136261u;
+    for (unsigned int i = 0; i < value.length(); i++) {
+        hash ^= (uint8_t) value[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+AnimationCache::~AnimationCache() {
+    clear();
+}
+
+LuaAnimation* AnimationCache::get(const String& name) {
+    auto found = index.find(name);
+    if (found == index.end()) {
+        misses++;
+        return nullptr;
+    }
+    hits++;
+    animations.splice(animations.begin(), animations, found->second);
+    return *found->second;
+}
+
+LuaAnimation* AnimationCache::peek(const String& name) {
+    auto found = index.find(name);
+    return found == index.end() ? nullptr : *found->second;
+}
+
+void AnimationCache::put(LuaAnimation* animation) {
+    auto found = index.find(animation->getName());
+    if (found != index.end()) {
+        remove(found->second);
+    }
+    animations.push_front(animation);
+    index[animation->getName()] = animations.begin();
+    trim();
+}
+
+LuaAnimation* AnimationCache::detach(const String& name) {
+    auto found = index.find(name);
+    if (found == index.end()) {
+        return nullptr;
+    }
+    LuaAnimation* animation = *found->second;
+    animations.erase(found->second);
+    index.erase(found);
+    if (animation == pinned) {
+        pinned = nullptr;
+    }
+    if (animation == pinnedOutgoing) {
+        pinnedOutgoing = nullptr;
+    }
+    return animation;
+}
+
+void AnimationCache::erase(const String& name) {
+    delete detach(name);
+}
+
+void AnimationCache::clear() {
+    for (auto animation : animations) {
+        delete animation;
+    }
+    animations.clear();
+    index.clear();
+    pinned = nullptr;
+    pinnedOutgoing = nullptr;
+}
+
+void AnimationCache::setMaxBytes(size_t maxBytes) {
+    AnimationCache::maxBytes = maxBytes;
+}
+
+void AnimationCache::setPinned(LuaAnimation* animation, LuaAnimation* outgoing) {
+    pinned = animation;
+    pinnedOutgoing = outgoing;
+}
+
+void AnimationCache::trim() {
+    if (maxBytes == 0) {
+        return;
+    }
+    size_t bytes = getBytes();
+    if (bytes > maxBytes) {
+        evict(bytes - maxBytes, nullptr);
+    }
+}
+
+size_t AnimationCache::evict(size_t bytes, LuaAllocator* skipped) {
+    size_t freed = 0;
+    auto entry = animations.end();
+    while (freed < bytes && entry != animations.begin() && entry != std::next(animations.begin())) {
+        --entry;
+        LuaAnimation* animation = *entry;
+        if (animation == pinned || animation == pinnedOutgoing || (skipped != nullptr && &animation->getAllocator() == skipped)) {
+            continue;
+        }
+        Serial.printf("Evicting shader \"%s\"\n", animation->getName().c_str());
+        freed += animation->getUsedBytes();
+        auto evicted = entry++;
+        remove(evicted);
+        evictions++;
+    }
+    return freed;
+}
+
+void AnimationCache::remove(std::list<LuaAnimation*>::iterator entry) {
+    LuaAnimation* animation = *entry;
+    index.erase(animation->getName());
+    animations.erase(entry);
+    if (animation == pinned) {
+        pinned = nullptr;
+    }
+    if (animation == pinnedOutgoing) {
+        pinnedOutgoing = nullptr;
+    }
+    delete animation;
+}
+
+std::list<LuaAnimation*>& AnimationCache::getAnimations() {
+    return animations;
+}
+
+size_t AnimationCache::getBytes() {
+    size_t bytes = 0;
+    for (auto animation : animations) {
+        bytes += animation->getUsedBytes();
+    }
+    return bytes;
+}
+
+uint32_t AnimationCache::getHits() {
+    return hits;
+}
+
+uint32_t AnimationCache::getMisses() {
+    return misses;
+}
+
+uint32_t AnimationCache::getEvictions() {
+    return evictions;
+}
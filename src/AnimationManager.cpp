@@ -1,65 +1,251 @@
 #include "AnimationManager.h"
 
+// the same per pixel work with fx integer math and with float math
+static const char* fxBenchmarkShader =
+    "local sin8, scale8, random8 = fx.sin8, fx.scale8, fx.random8\n"
+    "function frame(pixels, n, t)\n"
+    "    for i = 0, n - 1 do\n"
+    "        local h = sin8(i * 8 + t)\n"
+    "        pixels[i] = h << 16 | scale8(random8(), h)\n"
+    "    end\n"
+    "end\n";
+
+static const char* floatBenchmarkShader =
+    "local sin, floor, random, pi = math.sin, math.floor, math.random, math.pi\n"
+    "function frame(pixels, n, t)\n"
+    "    for i = 0, n - 1 do\n"
+    "        local h = floor((sin((i * 8 + t) * pi / 128) + 1) * 127.5)\n"
+    "        pixels[i] = h << 16 | floor(random() * h)\n"
+    "    end\n"
+    "end\n";
+
+AnimationManager* AnimationManager::lowMemoryManager = nullptr;
+
 AnimationManager::AnimationManager(ShaderStorage *storage, GlobalAnimationEnv* globalAnimationEnv)
 {
     AnimationManager::globalAnimationEnv = globalAnimationEnv;
     shaderStorage = storage;
-    loadedAnimations = new std::vector<LuaAnimation*>();
+    cache = new AnimationCache();
+    cache->setMaxBytes(settings.cacheMemoryBytes);
+    lowMemoryManager = this;
+    LuaAllocator::setLowMemoryHandler(onLowMemory);
+    lock = xSemaphoreCreateRecursiveMutex();
+    outputLock = xSemaphoreCreateMutex();
+    workerDone = xSemaphoreCreateBinary();
 }
 
 AnimationManager::~AnimationManager()
 {
-    for (auto anim : *loadedAnimations) {
-        delete anim;
+    if (renderTaskHandle != nullptr) {
+        vTaskDelete(renderTaskHandle);
+    }
+    if (outputTaskHandle != nullptr) {
+        vTaskDelete(outputTaskHandle);
+    }
+    if (workerTaskHandle != nullptr) {
+        vTaskDelete(workerTaskHandle);
     }
-    delete loadedAnimations;
+    if (loaderTaskHandle != nullptr) {
+        vTaskDelete(loaderTaskHandle);
+    }
+    delete twin;
+    delete retired;
+    LuaAllocator::setLowMemoryHandler(nullptr);
+    lowMemoryManager = nullptr;
+    delete cache;
+    delete sharedRuntime;
     delete shaders;
-    delete leds;
+    freeBuffers();
+    vSemaphoreDelete(lock);
+    vSemaphoreDelete(outputLock);
+    vSemaphoreDelete(workerDone);
 }
 
+// steps from a selection still loading, so quick presses are not lost
 void AnimationManager::previous() {
+    RecursiveLock guard(lock);
+    if (shaders->size() == 0) {
+        return;
+    }
+    int selected = findShader(selectedShader);
+    uint16_t index = selected >= 0 ? selected : currentAnimationShaderIndex;
+    String name = (*shaders)[(index + shaders->size() - 1) % shaders->size()];
+    select(name);
 }
 
 void AnimationManager::next() {
+    RecursiveLock guard(lock);
+    if (shaders->size() == 0) {
+        return;
+    }
+    int selected = findShader(selectedShader);
+    uint16_t index = selected >= 0 ? selected : currentAnimationShaderIndex;
+    String name = (*shaders)[(index + 1) % shaders->size()];
+    select(name);
 }
 
 void AnimationManager::faster() {
-    if (speed <= 90)
-        speed += 10;
+    RecursiveLock guard(lock);
+    if (settings.speed <= SPEED_MAX - SPEED_STEP)
+        settings.speed += SPEED_STEP;
 }
 
 void AnimationManager::slower() {
-    if (speed >= 10)
-        speed -= 10;
+    RecursiveLock guard(lock);
+    if (settings.speed >= SPEED_STEP)
+        settings.speed -= SPEED_STEP;
 }
 
 CallResult<void*> AnimationManager::select(String& shaderName) {
-    uint16_t shaderSize = shaders->size();
-    uint16_t foundShaderIndex = 0;
-    bool notFound = true;
-    for (uint16_t i = 0; i < shaderSize; i++) {
-        if ((*shaders)[i] == shaderName) {
-            foundShaderIndex = i;
-            notFound = false;
-            break;
+    return select(shaderName, Transition(settings.transition, settings.transitionMillis));
+}
+
+CallResult<void*> AnimationManager::select(String& shaderName, Transition transition) {
+    uint32_t start = micros();
+    RecursiveLock guard(lock);
+    if (findShader(shaderName) < 0) {
+        return CallResult<void*>(nullptr, 404, "No such shader");
+    }
+    if (loaderTaskHandle == nullptr || cache->peek(shaderName) != nullptr) {
+        // the lock is only free between frames, the switch happens at a frame boundary
+        selectedShader = "";
+        selectQueued = false;
+        selectReady = false;
+        CallResult<void*> selectResult = selectNow(shaderName, transition);
+        if (!selectResult.hasError()) {
+            stats.switchMicros = micros() - start;
         }
+        return selectResult;
     }
-    if (notFound) {
+
+    queueSelect(shaderName, transition, start);
+    return CallResult<void*>(nullptr, 202);
+}
+
+void AnimationManager::queueSelect(String& shaderName, Transition transition, uint32_t startMicros) {
+    selectedShader = shaderName;
+    selectedTransition = transition;
+    selectQueued = true;
+    selectReady = false;
+    selectStartMicros = startMicros;
+    xTaskNotifyGive(loaderTaskHandle);
+}
+
+CallResult<void*> AnimationManager::selectNow(String& shaderName, Transition transition) {
+    int found = findShader(shaderName);
+    if (found < 0) {
         return CallResult<void*>(nullptr, 404, "No such shader");
     }
-    currentAnimationShaderIndex = foundShaderIndex;
+    currentAnimationShaderIndex = found;
     CallResult<LuaAnimation*> loadResult = loadCached((*shaders)[currentAnimationShaderIndex]);
     if (loadResult.hasError()) {
         return CallResult<void*>(nullptr, loadResult.getCode(), loadResult.getMessage().c_str());
     }
-    setCurrentAnimation(loadResult.getValue());
+    setCurrentAnimation(loadResult.getValue(), transition);
     return CallResult<void*>(nullptr, 200);
 }
 
+int AnimationManager::findShader(const String& shaderName) {
+    for (size_t i = 0; i < shaders->size(); i++) {
+        if ((*shaders)[i] == shaderName) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+CallResult<void*> AnimationManager::connect(std::vector<LedOutput>& outputs) {
+    CallResult<void*> validation = LedOutputs::validate(outputs);
+    if (validation.hasError()) {
+        return validation;
+    }
+    CallResult<void*> loadResult = reload();
+    if (loadResult.hasError()) {
+        return loadResult;
+    }
+
+    this->outputs = outputs;
+    allocateBuffers();
+    CallResult<void*> controllersResult = LedOutputs::addControllers(this->outputs, wire);
+    if (controllersResult.hasError()) {
+        return controllersResult;
+    }
+    // brightness is applied by post processing
+    FastLED.setBrightness(255);
+    configurePost();
+    FastLED.clear(true);
+    startTasks();
+    return CallResult<void*>(nullptr);
+}
+
+CallResult<void*> AnimationManager::reconfigure(std::vector<LedOutput>& outputs) {
+    CallResult<void*> validation = LedOutputs::validate(outputs);
+    if (validation.hasError()) {
+        return validation;
+    }
+    if (!LedOutputs::canAddControllers(outputs)) {
+        return CallResult<void*>(nullptr, 409, "Chipset of a driven pin changes only after reboot");
+    }
+
+    RecursiveLock guard(lock);
+    xSemaphoreTake(outputLock, portMAX_DELAY);
+    FastLED.clear(true);
+    freeBuffers();
+    this->outputs = outputs;
+    allocateBuffers();
+    // validated and checked against the registered chipsets above, adding can not fail
+    LedOutputs::addControllers(this->outputs, wire);
+    blendDone = true;
+    xSemaphoreGive(outputLock);
+
+    // shaders may keep tables sized by the old length
+    Serial.printf("Outputs reconfigured to %d leds\n", size);
+    return reload();
+}
+
+std::vector<LedOutput>& AnimationManager::getOutputs() {
+    return outputs;
+}
+
+void AnimationManager::allocateBuffers() {
+    size = LedOutputs::totalLength(outputs);
+    leds = new CRGB[size]();
+    lastFrame = new CRGB[size]();
+    output = new CRGB[size]();
+    wire = new CRGB[size]();
+    frames = new FrameBuffers(size);
+    transitionFrame = new CRGB[size]();
+    blendFrame = new CRGB[size]();
+    keyframeFrom = new CRGB[size]();
+    keyframeTo = new CRGB[size]();
+}
+
+void AnimationManager::freeBuffers() {
+    delete[] leds;
+    delete[] lastFrame;
+    delete[] output;
+    delete[] wire;
+    delete[] keyframeFrom;
+    delete[] keyframeTo;
+    delete[] transitionFrame;
+    delete[] blendFrame;
+    delete frames;
+    leds = nullptr;
+    lastFrame = nullptr;
+    output = nullptr;
+    wire = nullptr;
+    keyframeFrom = nullptr;
+    keyframeTo = nullptr;
+    transitionFrame = nullptr;
+    blendFrame = nullptr;
+    frames = nullptr;
+}
+
 CallResult<void*> AnimationManager::draw() {
     if (leds == nullptr) {
         return CallResult<void*>(nullptr, 500, "Leds were not connected programmaticaly");
     }
+    RecursiveLock guard(lock);
 
     if (toReload) {
         CallResult<void*> reloadResult = reload();
@@ -68,37 +254,621 @@ CallResult<void*> AnimationManager::draw() {
         }
         toReload = false;
     }
+    if (selectReady) {
+        swapSelected();
+    }
+    if (sharedEvictionBytes > 0) {
+        evictShared();
+    }
 
+    uint32_t start = micros();
+    bool rendered = false;
     if (currentAnimation == nullptr) {
-        FastLED.clear(true);
-        lastUpdate = millis();
+        fill_solid(leds, size, CRGB::Black);
+    }
+    else if (invariantFrame) {
+        return CallResult<void*>(nullptr, 200);
+    }
+    else {
+        CallResult<void*> applyResult = applyCurrent();
+        stats.frameAllocations = currentAnimation->getFrameAllocations();
+        stats.luaBytes = currentAnimation->getUsedBytes();
+        stats.luaPoolBytes = LuaAllocator::getPoolBytes();
+        stats.sharedStateBytes = sharedRuntime != nullptr ? sharedRuntime->getAllocator().getUsedBytes() : 0;
+        stats.budgetOverruns = currentAnimation->getBudgetOverruns();
+        stats.transitioning = transitionFrom != nullptr;
+        stats.cacheBytes = cache->getBytes();
+        stats.cacheHits = cache->getHits();
+        stats.cacheMisses = cache->getMisses();
+        stats.cacheEvictions = cache->getEvictions();
+        stats.quarantined = currentAnimation->isQuarantined();
+        if (applyResult.hasError()) {
+            // strip keeps showing the last good frame, a blended one is no shader's canvas
+            if (transitionFrom == nullptr) {
+                memcpy(leds, lastFrame, size * sizeof(CRGB));
+            }
+            return applyResult;
+        }
+        if (transitionFrom != nullptr) {
+            applyTransition();
+        }
+        stats.renderMicros = micros() - start;
+        rendered = true;
+    }
+    lastUpdate = millis();
+    CRGB* frame = transitionFrom != nullptr ? blendFrame : leds;
+
+    // lastFrame always holds what was last sent to the strip, so the compare is exact
+    bool unchanged = frameShown && memcmp(frame, lastFrame, size * sizeof(CRGB)) == 0;
+    if (currentAnimation != nullptr && transitionFrom == nullptr) {
+        detectInvariance();
+    }
+    if (unchanged) {
+        stats.skippedFrames++;
     }
     else {
-        currentAnimation->apply(leds, size);
-        FastLED.show();
-        lastUpdate = millis();
+        memcpy(lastFrame, frame, size * sizeof(CRGB));
+        frames->publish(frame);
+        frameShown = true;
+        xTaskNotifyGive(outputTaskHandle);
     }
 
+    // in the slack after the frame went to the output task
+    if (rendered) {
+        collectGarbage();
+    }
     return CallResult<void*>(nullptr, 200);
 }
 
+// sends out the latest published frame, runs on the output task
+void AnimationManager::show() {
+    CRGB* frame = frames->acquire();
+    bool postChanged = post.update(millis());
+    if (frame == nullptr && !postChanged) {
+        return;
+    }
+    uint32_t start = micros();
+    if (frame != nullptr) {
+        memcpy(output, frame, size * sizeof(CRGB));
+    }
+    sendOutput();
+    stats.showMicros = micros() - start;
+    countOutputFrame(start);
+}
+
+// blends towards the latest keyframe over one keyframe interval, a new keyframe starts
+// from the frame on the strip so a late or early keyframe never jumps
+void AnimationManager::showInterpolated() {
+    uint32_t start = micros();
+    CRGB* frame = frames->acquire();
+    if (frame != nullptr) {
+        memcpy(keyframeFrom, output, size * sizeof(CRGB));
+        memcpy(keyframeTo, frame, size * sizeof(CRGB));
+        keyframeStartMicros = start;
+        blendDone = false;
+    }
+    bool postChanged = post.update(millis());
+    if (blendDone && !postChanged) {
+        return;
+    }
+
+    if (!blendDone) {
+        uint32_t progress = (uint64_t) (start - keyframeStartMicros) * settings.keyframeFps * 256 / 1000000;
+        if (progress >= 255) {
+            memcpy(output, keyframeTo, size * sizeof(CRGB));
+            blendDone = true;
+        }
+        else {
+            blend(keyframeFrom, keyframeTo, output, size, progress);
+        }
+    }
+    sendOutput();
+    stats.showMicros = micros() - start;
+    countOutputFrame(start);
+}
+
+// rmt channels of all outputs run at once, the wire time is that of the longest output
+void AnimationManager::sendOutput() {
+    post.toWire(outputs, output, wire);
+    FastLED.show();
+    stats.requestedMilliamps = post.getRequestedMilliamps();
+    stats.milliamps = post.getMilliamps();
+    stats.powerLimitedFrames = post.getLimitedFrames();
+}
+
+void AnimationManager::countOutputFrame(uint32_t now) {
+    outputWindowFrames++;
+    if (now - outputWindowStart >= 1000000) {
+        stats.outputFps = outputWindowFrames;
+        outputWindowFrames = 0;
+        outputWindowStart = now;
+    }
+}
+
+bool AnimationManager::interpolating() {
+    return settings.keyframeFps > 0 && settings.keyframeFps < settings.targetFps;
+}
+
+// splits per pixel shaders between this task and the worker when parallel mode is on,
+// both halves join before the frame is published and env only changes between frames
+CallResult<void*> AnimationManager::applyCurrent() {
+    if (!settings.parallel || !prepareTwin()) {
+        stats.parallel = false;
+        return currentAnimation->apply(leds, size);
+    }
+
+    stats.parallel = true;
+    workerFrom = size / 2;
+    xTaskNotifyGive(workerTaskHandle);
+    CallResult<void*> result = currentAnimation->apply(leds, size, 0, workerFrom);
+    xSemaphoreTake(workerDone, portMAX_DELAY);
+    if (workerResult.hasError()) {
+        // the shader goes on in its main state alone, budgets and quarantine apply there
+        Serial.printf("Parallel half failed, rendering on one core: %s\n", workerResult.getMessage().c_str());
+        dropTwin();
+        twinRejected = true;
+        if (!result.hasError()) {
+            return workerResult;
+        }
+    }
+    return result;
+}
+
+// Loads the current shader into a second state of its own. A shader keeping state across pixels
+// renders differently when its halves run in separate states, so the twin renders one frame split
+// in the opposite order and is rejected unless it matches the current state rendering it serially
+bool AnimationManager::prepareTwin() {
+    if (twin != nullptr) {
+        return true;
+    }
+    if (twinRejected || !currentAnimation->isPerPixel()) {
+        return false;
+    }
+
+    twinRejected = true;
+    String name = currentAnimation->getName();
+    CallResult<LuaAnimation*> loadResult = loadAnimation(name, nullptr);
+    if (loadResult.hasError()) {
+        Serial.printf("Shader \"%s\" can't render in parallel: %s\n", name.c_str(), loadResult.getMessage().c_str());
+        return false;
+    }
+    LuaAnimation* candidate = loadResult.getValue();
+    // the twin collects its garbage while it renders
+    candidate->configureGc(false, settings.gcPause, settings.gcStepMul);
+
+    CRGB* serial = new CRGB[size]();
+    CRGB* split = new CRGB[size]();
+    size_t half = size / 2;
+    bool matches = !currentAnimation->apply(serial, size).hasError()
+        && !candidate->apply(split, size, half, size).hasError()
+        && !candidate->apply(split, size, 0, half).hasError()
+        && memcmp(serial, split, size * sizeof(CRGB)) == 0;
+    delete[] serial;
+    delete[] split;
+
+    if (!matches) {
+        Serial.printf("Shader \"%s\" keeps state across pixels, rendering it on one core\n", name.c_str());
+        delete candidate;
+        return false;
+    }
+    twinRejected = false;
+    twin = candidate;
+    return true;
+}
+
+// the outgoing shader renders on its own canvas, both canvases are blended into blendFrame
+// and left as the shaders drew them. A failing outgoing shader ends the transition early
+void AnimationManager::applyTransition() {
+    uint32_t elapsed = micros() - transitionStartMicros;
+    uint32_t duration = (uint32_t) transition.durationMillis * 1000;
+    if (elapsed >= duration || transitionFrom->apply(transitionFrame, size).hasError()) {
+        dropTransition();
+        return;
+    }
+    transition.apply(transitionFrame, leds, blendFrame, size, (uint64_t) elapsed * 256 / duration);
+}
+
+void AnimationManager::dropTransition() {
+    transitionFrom = nullptr;
+    cache->setPinned(currentAnimation);
+    releaseRetired();
+}
+
+void AnimationManager::dropTwin() {
+    delete twin;
+    twin = nullptr;
+    twinRejected = false;
+}
+
+void AnimationManager::startTasks() {
+    xTaskCreatePinnedToCore(workerTask, "worker", WORKER_TASK_STACK, this, WORKER_TASK_PRIORITY, &workerTaskHandle, WORKER_TASK_CORE);
+    xTaskCreatePinnedToCore(outputTask, "output", OUTPUT_TASK_STACK, this, OUTPUT_TASK_PRIORITY, &outputTaskHandle, OUTPUT_TASK_CORE);
+    xTaskCreatePinnedToCore(loaderTask, "loader", LOADER_TASK_STACK, this, LOADER_TASK_PRIORITY, &loaderTaskHandle, LOADER_TASK_CORE);
+    xTaskCreatePinnedToCore(renderTask, "render", RENDER_TASK_STACK, this, RENDER_TASK_PRIORITY, &renderTaskHandle, RENDER_TASK_CORE);
+}
+
+void AnimationManager::renderTask(void *arg) {
+    AnimationManager* manager = (AnimationManager*) arg;
+    manager->lastTickMicros = micros();
+    manager->nextFrameMicros = manager->lastTickMicros;
+    manager->fpsWindowStart = manager->lastTickMicros;
+    for (;;) {
+        manager->advanceTime();
+        CallResult<void*> result = manager->draw();
+        manager->keepDrawResult(result);
+        manager->waitNextFrame(manager->nextFrameMicros, manager->renderFps());
+    }
+}
+
+uint16_t AnimationManager::renderFps() {
+    return interpolating() ? settings.keyframeFps : settings.targetFps;
+}
+
+// a failing shader fails every frame, an error is only logged when it changes
+void AnimationManager::keepDrawResult(CallResult<void*>& result) {
+    RecursiveLock guard(lock);
+    if (result.hasError() && result.getMessage() != drawResult.getMessage()) {
+        Serial.printf("Frame failed: %s\n", result.getMessage().c_str());
+    }
+    drawResult = result;
+}
+
+// shader time advances by the real time since the last frame scaled by speed
+void AnimationManager::advanceTime() {
+    uint32_t now = micros();
+    shaderMicros += (uint64_t) (now - lastTickMicros) * settings.speed / 100;
+    lastTickMicros = now;
+
+    uint32_t timeMillis = shaderMicros / 1000;
+    globalAnimationEnv->dtMillis = timeMillis - globalAnimationEnv->timeMillis;
+    globalAnimationEnv->timeMillis = timeMillis;
+    globalAnimationEnv->iteration++;
+
+    fpsWindowFrames++;
+    if (now - fpsWindowStart >= 1000000) {
+        stats.renderFps = fpsWindowFrames;
+        fpsWindowFrames = 0;
+        fpsWindowStart = now;
+    }
+}
+
+// sleeps until the next frame deadline, a late frame moves the deadline instead of rendering a burst.
+// Always gives up at least a tick so the arduino loop on the same core runs
+void AnimationManager::waitNextFrame(uint32_t& deadlineMicros, uint16_t fps) {
+    if (fps == 0) {
+        vTaskDelay(1);
+        return;
+    }
+
+    deadlineMicros += 1000000 / fps;
+    int32_t remaining = (int32_t) (deadlineMicros - micros());
+    if (remaining <= 0) {
+        deadlineMicros = micros();
+        vTaskDelay(1);
+        return;
+    }
+    TickType_t ticks = pdMS_TO_TICKS(remaining / 1000);
+    vTaskDelay(ticks > 0 ? ticks : 1);
+}
+
+void AnimationManager::workerTask(void *arg) {
+    AnimationManager* manager = (AnimationManager*) arg;
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        manager->workerResult = manager->twin->apply(manager->leds, manager->size, manager->workerFrom, manager->size);
+        xSemaphoreGive(manager->workerDone);
+    }
+}
+
+// selections go first, then a queued benchmark, neighbours are preloaded once nothing else waits
+void AnimationManager::loaderTask(void *arg) {
+    AnimationManager* manager = (AnimationManager*) arg;
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        while (manager->loadSelected()) {
+        }
+        manager->runBenchmark();
+        manager->preloadNeighbours();
+    }
+}
+
+// loads the latest selection into the cache, false if none was queued
+bool AnimationManager::loadSelected() {
+    String name;
+    uint32_t generation;
+    {
+        RecursiveLock guard(lock);
+        if (!selectQueued) {
+            return false;
+        }
+        selectQueued = false;
+        name = selectedShader;
+        generation = cacheGeneration;
+    }
+
+    CallResult<void*> loadResult = loadDetached(name, generation);
+
+    RecursiveLock guard(lock);
+    if (selectQueued || selectedShader != name) {
+        // selected again meanwhile
+        return true;
+    }
+    if (generation != cacheGeneration) {
+        // reloaded meanwhile, the shader may have changed
+        selectQueued = true;
+        return true;
+    }
+    if (loadResult.hasError()) {
+        Serial.printf("Shader \"%s\" failed to load: %s\n", name.c_str(), loadResult.getMessage().c_str());
+        selectedShader = "";
+        if (listener != nullptr) {
+            listener->animationSelectFailed(name, loadResult.getMessage());
+        }
+        return true;
+    }
+    selectReady = true;
+    return true;
+}
+
+// runs on the render task between frames, the shader is cached unless it was evicted meanwhile
+void AnimationManager::swapSelected() {
+    String name = selectedShader;
+    selectedShader = "";
+    selectReady = false;
+    CallResult<void*> selectResult = selectNow(name, selectedTransition);
+    if (selectResult.hasError()) {
+        Serial.printf("Shader \"%s\" failed to load: %s\n", name.c_str(), selectResult.getMessage().c_str());
+        if (listener != nullptr) {
+            listener->animationSelectFailed(name, selectResult.getMessage());
+        }
+        return;
+    }
+    stats.switchMicros = micros() - selectStartMicros;
+}
+
+// loads the shaders before and after the current one so next and previous find them cached.
+// Recently used shaders stay loaded anyway, the cache drops them last
+void AnimationManager::preloadNeighbours() {
+    std::vector<String> names;
+    uint32_t generation;
+    {
+        RecursiveLock guard(lock);
+        if (!settings.preload || sharedRuntime != nullptr || currentAnimation == nullptr || shaders->size() < 2) {
+            return;
+        }
+        size_t count = shaders->size();
+        names.push_back((*shaders)[(currentAnimationShaderIndex + 1) % count]);
+        names.push_back((*shaders)[(currentAnimationShaderIndex + count - 1) % count]);
+        generation = cacheGeneration;
+    }
+    for (auto& name : names) {
+        preload(name, generation);
+    }
+}
+
+void AnimationManager::preload(String& shaderName, uint32_t generation) {
+    if (ESP.getFreeHeap() < PRELOAD_MIN_FREE_HEAP) {
+        return;
+    }
+    {
+        RecursiveLock guard(lock);
+        if (selectQueued || cache->peek(shaderName) != nullptr) {
+            return;
+        }
+    }
+    if (!loadDetached(shaderName, generation).hasError()) {
+        RecursiveLock guard(lock);
+        stats.preloads++;
+    }
+}
+
+// caches a shader from a task other than the render task. An own state is private to this task
+// until it is cached, so it is parsed and run without the lock and rendering never waits for it.
+// The shared state is only touched under the lock, shaders in it load holding the lock throughout
+CallResult<void*> AnimationManager::loadDetached(String& shaderName, uint32_t generation) {
+    LuaAnimation* animation;
+    {
+        RecursiveLock guard(lock);
+        if (generation != cacheGeneration) {
+            return CallResult<void*>(nullptr, 409, "Shaders were reloaded");
+        }
+        if (cache->peek(shaderName) != nullptr) {
+            return CallResult<void*>(nullptr, 200);
+        }
+        if (sharedRuntime != nullptr) {
+            CallResult<LuaAnimation*> loadResult = loadCached(shaderName);
+            if (loadResult.hasError()) {
+                return CallResult<void*>(nullptr, loadResult.getCode(), loadResult.getMessage().c_str());
+            }
+            return CallResult<void*>(nullptr, 200);
+        }
+        Serial.printf("Loading shader \"%s\"\n", shaderName.c_str());
+        animation = new LuaAnimation(shaderName);
+        configure(animation);
+    }
+
+    CallResult<void*> beginResult = beginAnimation(animation);
+
+    RecursiveLock guard(lock);
+    if (beginResult.hasError()) {
+        delete animation;
+        return beginResult;
+    }
+    if (generation != cacheGeneration || cache->peek(shaderName) != nullptr) {
+        delete animation;
+        return CallResult<void*>(nullptr, generation != cacheGeneration ? 409 : 200, "Shaders were reloaded");
+    }
+    // settings may have changed while loading
+    configure(animation);
+    cache->put(animation);
+    return CallResult<void*>(nullptr, 200);
+}
+
+// shows each published frame, or paces itself to targetFps while interpolating keyframes
+// or fading brightness
+void AnimationManager::outputTask(void *arg) {
+    AnimationManager* manager = (AnimationManager*) arg;
+    manager->nextOutputMicros = micros();
+    manager->outputWindowStart = manager->nextOutputMicros;
+    for (;;) {
+        bool paced = manager->interpolating() || manager->post.isChanging();
+        if (!paced) {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        }
+        xSemaphoreTake(manager->outputLock, portMAX_DELAY);
+        if (manager->interpolating()) {
+            manager->showInterpolated();
+        }
+        else {
+            manager->show();
+            manager->blendDone = true;
+        }
+        xSemaphoreGive(manager->outputLock);
+        if (paced) {
+            manager->waitNextFrame(manager->nextOutputMicros, manager->settings.targetFps);
+        }
+        else {
+            manager->nextOutputMicros = micros();
+        }
+    }
+}
+
 void AnimationManager::scheduleReload() {
     toReload = true;
 }
 
-CallResult<void*> AnimationManager::reload() {
-    Serial.println("Performing cache cleanup");
-    for (auto anim : *loadedAnimations) {
-        delete anim;
+// the old version of the current shader renders until the new one is loaded on the loader task
+// and swapped in like a selection, a new version failing to load leaves the old one on
+void AnimationManager::shaderChanged(String& shaderName) {
+    RecursiveLock guard(lock);
+    cacheGeneration++;
+    if (findShader(shaderName) < 0) {
+        shaders->push_back(shaderName);
+    }
+    if (transitionFrom != nullptr && transitionFrom->getName() == shaderName) {
+        dropTransition();
+    }
+    bool current = currentAnimation != nullptr && currentAnimation->getName() == shaderName;
+    if (current) {
+        retireCurrent();
+    }
+    // a version loaded for an earlier edit
+    cache->erase(shaderName);
+
+    if (loaderTaskHandle == nullptr) {
+        scheduleReload();
+    }
+    else if (current) {
+        queueSelect(shaderName, Transition(settings.transition, settings.transitionMillis), micros());
+    }
+    else if (selectedShader == shaderName) {
+        queueSelect(shaderName, selectedTransition, selectStartMicros);
+    }
+    else {
+        xTaskNotifyGive(loaderTaskHandle);
+    }
+}
+
+// a deleted current shader renders until the one taking its place in the list is loaded
+void AnimationManager::shaderRemoved(String& shaderName) {
+    RecursiveLock guard(lock);
+    int found = findShader(shaderName);
+    if (found < 0) {
+        return;
+    }
+    cacheGeneration++;
+    shaders->erase(shaders->begin() + found);
+    if (currentAnimationShaderIndex > found) {
+        currentAnimationShaderIndex--;
+    }
+    if (selectedShader == shaderName) {
+        selectedShader = "";
+        selectQueued = false;
+        selectReady = false;
+    }
+    if (transitionFrom != nullptr && transitionFrom->getName() == shaderName) {
+        dropTransition();
+    }
+    if (currentAnimation == nullptr || currentAnimation->getName() != shaderName) {
+        cache->erase(shaderName);
+        return;
     }
-    loadedAnimations->clear();
-    delete shaders;
 
+    retireCurrent();
+    if (shaders->size() == 0) {
+        currentAnimationShaderIndex = 0;
+        setCurrentAnimation(nullptr);
+        return;
+    }
+    if (currentAnimationShaderIndex >= shaders->size()) {
+        currentAnimationShaderIndex = 0;
+    }
+    String next = (*shaders)[currentAnimationShaderIndex];
+    select(next);
+}
+
+// takes the current shader out of the cache, it is deleted once neither shown nor transitioned from
+void AnimationManager::retireCurrent() {
+    if (retired == currentAnimation) {
+        return;
+    }
+    dropTransition();
+    // a twin would load the new version
+    dropTwin();
+    twinRejected = true;
+    cache->detach(currentAnimation->getName());
+    retired = currentAnimation;
+}
+
+void AnimationManager::releaseRetired() {
+    if (retired != nullptr && retired != currentAnimation && retired != transitionFrom) {
+        delete retired;
+        retired = nullptr;
+    }
+}
+
+// the shader list and the shared state are replaced only once both are ready,
+// a failing reload leaves the previous ones in place to retry on the next frame
+CallResult<void*> AnimationManager::reload() {
     CallResult<std::vector<String>*> shadersResult = shaderStorage->listShaders();
     if (shadersResult.hasError()) {
         return CallResult<void*>(nullptr, shadersResult.getCode(), shadersResult.getMessage().c_str());
     }
+    LuaRuntime* runtime = nullptr;
+    if (settings.sharedState) {
+        runtime = new LuaRuntime();
+        CallResult<void*> runtimeResult = runtime->begin(globalAnimationEnv);
+        if (runtimeResult.hasError()) {
+            delete runtime;
+            delete shadersResult.getValue();
+            return runtimeResult;
+        }
+    }
+
+    Serial.println("Performing cache cleanup");
+    dropTwin();
+    dropTransition();
+    invalidateFrame();
+    currentAnimation = nullptr;
+    releaseRetired();
+    cache->clear();
+    cacheGeneration++;
+    if (selectReady) {
+        // the loaded selection went with the cache
+        selectReady = false;
+        selectQueued = true;
+        xTaskNotifyGive(loaderTaskHandle);
+    }
+
+    delete sharedRuntime;
+    sharedRuntime = runtime;
+    if (sharedRuntime != nullptr) {
+        configureSharedRuntime();
+    }
+
+    std::vector<String>* previousShaders = shaders;
     shaders = shadersResult.getValue();
+    delete previousShaders;
     if (shaders->size() == 0) {
         currentAnimationShaderIndex = 0;
         setCurrentAnimation(nullptr);
@@ -107,7 +877,7 @@ CallResult<void*> AnimationManager::reload() {
     String savedShader = shaderStorage->getLastShader();
     bool saveLoaded = false;
     if (savedShader != "") {
-        CallResult<void*> result = select(savedShader);
+        CallResult<void*> result = selectNow(savedShader);
         if (!result.hasError()) {
             saveLoaded = true;
         }
@@ -130,37 +900,51 @@ CallResult<void*> AnimationManager::reload() {
 }
 
 CallResult<LuaAnimation*> AnimationManager::loadCached(String& shaderName) {
-    for (auto anim : *loadedAnimations) {
-        if (anim->getName() == shaderName) {
-            return anim;
-        }
+    LuaAnimation* cached = cache->get(shaderName);
+    if (cached != nullptr) {
+        return cached;
     }
 
-    Serial.printf("Loading shader \"%s\"\n", shaderName.c_str());
-    CallResult<String> shaderResult = shaderStorage->getShader(shaderName);
-    if (shaderResult.hasError()) {
-        return CallResult<LuaAnimation *>(nullptr, shaderResult.getCode(), shaderResult.getMessage().c_str());
+    CallResult<LuaAnimation*> loadResult = loadAnimation(shaderName, sharedRuntime);
+    if (loadResult.hasError()) {
+        return loadResult;
     }
-    String shader = shaderResult.getValue();
+    LuaAnimation* animation = loadResult.getValue();
+
+    cache->put(animation);
+    return CallResult<LuaAnimation *>(animation, 200);
+}
 
-    LuaAnimation* animation = new LuaAnimation(shaderName);
-    CallResult<void*> beginResult = animation->begin(shader, globalAnimationEnv);
+CallResult<LuaAnimation*> AnimationManager::loadAnimation(String& shaderName, LuaRuntime* runtime) {
+    Serial.printf("Loading shader \"%s\"\n", shaderName.c_str());
+    LuaAnimation* animation = new LuaAnimation(shaderName, runtime);
+    configure(animation);
+    CallResult<void*> beginResult = beginAnimation(animation);
     if (beginResult.hasError()) {
         delete animation;
         return CallResult<LuaAnimation *>(nullptr, beginResult.getCode(), beginResult.getMessage().c_str());
     }
+    return CallResult<LuaAnimation *>(animation, 200);
+}
 
-    loadedAnimations->push_back(animation);
-    if (loadedAnimations->size() > CACHE_SIZE) {
-        LuaAnimation* toRemove = (*loadedAnimations)[0];
-        loadedAnimations->erase(loadedAnimations->begin());
-        delete toRemove;
+// reads the shader and its bytecode from storage, touches no state shared with rendering
+CallResult<void*> AnimationManager::beginAnimation(LuaAnimation* animation) {
+    String shaderName = animation->getName();
+    CallResult<String> shaderResult = shaderStorage->getShader(shaderName);
+    if (shaderResult.hasError()) {
+        return CallResult<void*>(nullptr, shaderResult.getCode(), shaderResult.getMessage().c_str());
     }
+    String shader = shaderResult.getValue();
+    CallResult<std::vector<uint8_t>*> bytecodeResult = shaderStorage->getBytecode(shaderName, shader);
+    std::vector<uint8_t>* bytecode = bytecodeResult.hasError() ? nullptr : bytecodeResult.getValue();
 
-    return CallResult<LuaAnimation *>(animation, 200);
+    CallResult<void*> beginResult = animation->begin(shader, bytecode, globalAnimationEnv);
+    delete bytecode;
+    return beginResult;
 }
 
 String AnimationManager::getCurrent() {
+    RecursiveLock guard(lock);
     if (currentAnimation == nullptr) {
         return "";
     } else {
@@ -168,16 +952,294 @@ String AnimationManager::getCurrent() {
     }
 }
 
+RenderStats& AnimationManager::getStats() {
+    return stats;
+}
+
+CallResult<void*> AnimationManager::getDrawResult() {
+    RecursiveLock guard(lock);
+    return drawResult;
+}
+
+RenderSettings AnimationManager::getSettings() {
+    RecursiveLock guard(lock);
+    return settings;
+}
+
+void AnimationManager::updateSettings(RenderSettings& updated) {
+    RecursiveLock guard(lock);
+    settings = updated;
+    applySettings();
+}
+
+void AnimationManager::applySettings() {
+    RecursiveLock guard(lock);
+    invalidateFrame();
+    configurePost();
+    if (!settings.parallel) {
+        dropTwin();
+    }
+    if (twin != nullptr) {
+        configure(twin);
+        twin->configureGc(false, settings.gcPause, settings.gcStepMul);
+    }
+    if (settings.sharedState != (sharedRuntime != nullptr)) {
+        scheduleReload();
+    }
+    if (sharedRuntime != nullptr) {
+        configureSharedRuntime();
+    }
+    cache->setMaxBytes(settings.cacheMemoryBytes);
+    for (auto anim : cache->getAnimations()) {
+        configure(anim);
+    }
+    cache->trim();
+    if (loaderTaskHandle != nullptr) {
+        xTaskNotifyGive(loaderTaskHandle);
+    }
+}
+
+// heap ran out under a lua allocation, cold states other than the requesting one go.
+// The cache is only touched if the lock is free or held by the allocating task
+size_t AnimationManager::onLowMemory(LuaAllocator *requester, size_t bytes) {
+    AnimationManager* manager = lowMemoryManager;
+    if (manager == nullptr || xSemaphoreTakeRecursive(manager->lock, 0) != pdTRUE) {
+        return 0;
+    }
+    size_t freed = 0;
+    if (manager->sharedRuntime != nullptr) {
+        // shaders in the shared state can't be released while lua may be inside one of its
+        // allocations, they go at the next frame
+        manager->sharedEvictionBytes += bytes;
+    }
+    else {
+        freed = manager->cache->evict(bytes, requester);
+        if (freed > 0) {
+            manager->stats.lowMemoryEvictions++;
+        }
+    }
+    xSemaphoreGiveRecursive(manager->lock);
+    return freed;
+}
+
+// runs between frames under the lock, no lua code of the shared state is running
+void AnimationManager::evictShared() {
+    size_t bytes = sharedEvictionBytes;
+    sharedEvictionBytes = 0;
+    if (sharedRuntime == nullptr) {
+        return;
+    }
+    if (cache->evict(bytes, nullptr) > 0) {
+        stats.lowMemoryEvictions++;
+        lua_gc(sharedRuntime->getState(), LUA_GCCOLLECT, 0);
+    }
+}
+
+void AnimationManager::configurePost() {
+    post.configure(settings.brightness, settings.gamma, settings.correction, settings.brightnessFadeMillis);
+    post.setPowerBudget(settings.powerBudgetMilliamps);
+    if (outputTaskHandle != nullptr) {
+        xTaskNotifyGive(outputTaskHandle);
+    }
+}
+
+void AnimationManager::configureSharedRuntime() {
+    sharedRuntime->setMemoryCap(settings.sharedStateMemoryCap);
+    sharedRuntime->configureGc(settings.gcStepBudgetMicros > 0, settings.gcPause, settings.gcStepMul);
+}
+
+void AnimationManager::configure(LuaAnimation* animation) {
+    auto subsample = subsampleOverrides.find(animation->getName());
+    animation->setSubsample(subsample != subsampleOverrides.end() ? subsample->second : 0);
+    animation->setMemoryCap(settings.shaderMemoryCap);
+    animation->configureGc(settings.gcStepBudgetMicros > 0, settings.gcPause, settings.gcStepMul);
+    animation->configureBudget(settings.frameBudgetInstructions, settings.frameBudgetMicros,
+        settings.loadBudgetInstructions, settings.loadBudgetMicros, settings.quarantineOverruns);
+}
+
+void AnimationManager::collectGarbage() {
+    if (settings.gcStepBudgetMicros == 0) {
+        return;
+    }
+
+    uint32_t start = micros();
+    size_t usedBytes = sharedRuntime != nullptr ? sharedRuntime->getAllocator().getUsedBytes() : currentAnimation->getUsedBytes();
+    size_t memoryCap = sharedRuntime != nullptr ? settings.sharedStateMemoryCap : settings.shaderMemoryCap;
+    bool underPressure = ESP.getFreeHeap() < GC_MIN_FREE_HEAP
+        || (memoryCap > 0 && usedBytes > memoryCap / 100 * settings.gcPressurePercent);
+
+    // ends with the budget or when the next frame is due, whichever comes first. A late frame
+    // leaves no slack and skips the step unless memory is short
+    uint32_t deadline = start + settings.gcStepBudgetMicros;
+    uint16_t fps = renderFps();
+    if (fps > 0 && !underPressure) {
+        uint32_t frameDeadline = nextFrameMicros + 1000000 / fps;
+        if ((int32_t) (frameDeadline - start) <= 0) {
+            stats.gcMicros = 0;
+            return;
+        }
+        if ((int32_t) (frameDeadline - deadline) < 0) {
+            deadline = frameDeadline;
+        }
+    }
+    if (currentAnimation->collectGarbage(deadline, settings.gcStepKb, underPressure)) {
+        stats.gcFullCollections++;
+    }
+    stats.gcMicros = micros() - start;
+}
+
+size_t AnimationManager::getShaderMemory(const String& shaderName) {
+    RecursiveLock guard(lock);
+    LuaAnimation* animation = cache->peek(shaderName);
+    return animation != nullptr ? animation->getUsedBytes() : 0;
+}
+
+uint8_t AnimationManager::setSubsample(const String& shaderName, uint8_t factor) {
+    RecursiveLock guard(lock);
+    if (factor == 0) {
+        subsampleOverrides.erase(shaderName);
+    } else {
+        subsampleOverrides[shaderName] = factor;
+    }
+    if (twin != nullptr && twin->getName() == shaderName) {
+        twin->setSubsample(factor);
+    }
+    uint8_t subsample = 0;
+    LuaAnimation* animation = cache->peek(shaderName);
+    if (animation != nullptr) {
+        animation->setSubsample(factor);
+        subsample = animation->getSubsample();
+    }
+    invalidateFrame();
+    return subsample;
+}
+
+CallResult<void*> AnimationManager::startFxBenchmark(int frames) {
+    RecursiveLock guard(lock);
+    if (loaderTaskHandle == nullptr) {
+        return CallResult<void*>(nullptr, 503, "Leds were not connected programmaticaly");
+    }
+    if (benchmarkFrames != 0 || benchmarkResult.getCode() == 202) {
+        return CallResult<void*>(nullptr, 409, "A benchmark is running");
+    }
+    benchmarkFrames = constrain(frames, 1, FX_BENCHMARK_MAX_FRAMES);
+    benchmarkResult = CallResult<FxBenchmark>(FxBenchmark(), 202, "Benchmark is running");
+    xTaskNotifyGive(loaderTaskHandle);
+    return CallResult<void*>(nullptr, 202);
+}
+
+CallResult<FxBenchmark> AnimationManager::getFxBenchmark() {
+    RecursiveLock guard(lock);
+    return benchmarkResult;
+}
+
+// the benchmark states are private to the loader task, only the result is published under the lock
+void AnimationManager::runBenchmark() {
+    int frames;
+    size_t pixels;
+    {
+        RecursiveLock guard(lock);
+        frames = benchmarkFrames;
+        pixels = size;
+        benchmarkFrames = 0;
+    }
+    if (frames == 0) {
+        return;
+    }
+    CallResult<FxBenchmark> result = benchmarkFx(frames, pixels);
+    RecursiveLock guard(lock);
+    benchmarkResult = result;
+}
+
+CallResult<FxBenchmark> AnimationManager::benchmarkFx(int frames, size_t pixels) {
+    FxBenchmark benchmark;
+    benchmark.frames = frames;
+    benchmark.pixels = pixels;
+
+    CRGB* scratch = new CRGB[pixels]();
+    CallResult<uint32_t> fxResult = benchmarkShader(fxBenchmarkShader, scratch, pixels, frames);
+    CallResult<uint32_t> floatResult = benchmarkShader(floatBenchmarkShader, scratch, pixels, frames);
+    delete[] scratch;
+
+    if (fxResult.hasError()) {
+        return CallResult<FxBenchmark>(benchmark, fxResult.getCode(), fxResult.getMessage().c_str());
+    }
+    if (floatResult.hasError()) {
+        return CallResult<FxBenchmark>(benchmark, floatResult.getCode(), floatResult.getMessage().c_str());
+    }
+    benchmark.fxMicros = fxResult.getValue();
+    benchmark.floatMicros = floatResult.getValue();
+    return CallResult<FxBenchmark>(benchmark);
+}
+
+// runs a frame shader in its own state on a scratch buffer, returns micros per frame.
+// Memory cap and budgets of shaders apply, an overrun ends the benchmark
+CallResult<uint32_t> AnimationManager::benchmarkShader(const char* code, CRGB* scratch, size_t pixels, int frames) {
+    String name("benchmark");
+    String shader(code);
+    LuaAnimation* animation = new LuaAnimation(name);
+    {
+        RecursiveLock guard(lock);
+        configure(animation);
+    }
+    CallResult<void*> beginResult = animation->begin(shader, nullptr, globalAnimationEnv);
+    if (beginResult.hasError()) {
+        delete animation;
+        return CallResult<uint32_t>(0, beginResult.getCode(), beginResult.getMessage().c_str());
+    }
+
+    uint32_t start = micros();
+    for (int i = 0; i < frames; i++) {
+        CallResult<void*> applyResult = animation->apply(scratch, pixels);
+        if (applyResult.hasError()) {
+            delete animation;
+            return CallResult<uint32_t>(0, applyResult.getCode(), applyResult.getMessage().c_str());
+        }
+    }
+    uint32_t elapsed = micros() - start;
+    delete animation;
+    return CallResult<uint32_t>(elapsed / frames);
+}
+
+void AnimationManager::invalidateFrame() {
+    frameShown = false;
+    invariantFrame = false;
+    stats.timeInvariant = false;
+}
+
+// only declared, shaders can animate from os.clock, math.random or their own globals without reading env
+void AnimationManager::detectInvariance() {
+    invariantFrame = currentAnimation->isTimeInvariant();
+    stats.timeInvariant = invariantFrame;
+}
+
 void AnimationManager::setListener(SelectAnimationListener* listener) {
     AnimationManager::listener = listener;
 }
 
-void AnimationManager::setCurrentAnimation(LuaAnimation* animation) {
+// a transition starting during another one starts from the shader that was coming in
+void AnimationManager::setCurrentAnimation(LuaAnimation* animation, Transition transition) {
+    if (animation != currentAnimation) {
+        dropTwin();
+        invalidateFrame();
+        bool visible = !transition.isCut() && animation != nullptr && currentAnimation != nullptr && transitionFrame != nullptr;
+        transitionFrom = visible ? currentAnimation : nullptr;
+        if (visible) {
+            // the outgoing shader takes its canvas along, the incoming one draws on leds
+            memcpy(transitionFrame, leds, size * sizeof(CRGB));
+        }
+        AnimationManager::transition = transition;
+        transitionStartMicros = micros();
+    }
     currentAnimation = animation;
+    cache->setPinned(animation, transitionFrom);
+    releaseRetired();
     String animationName;
 
     if (animation != nullptr) {
         animationName = animation->getName();
+        stats.loadMicros = animation->getLoadMicros();
+        stats.loadedFromBytecode = animation->isLoadedFromBytecode();
     } else {
         animationName = "";
     }
@@ -187,4 +1249,7 @@ void AnimationManager::setCurrentAnimation(LuaAnimation* animation) {
     if (listener != nullptr) {
         listener->animationSelected(animationName);
     }
+    if (animation != nullptr && loaderTaskHandle != nullptr) {
+        xTaskNotifyGive(loaderTaskHandle);
+    }
 }
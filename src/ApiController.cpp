@@ -14,10 +14,19 @@ void ApiController::onAddShader(AsyncWebServerRequest *request, JsonVariant &jso
     Serial.println("*** BEGIN SHADER ***");
     Serial.println(shader);
     Serial.println("*** END SHADER ***");
-    CallResult<void*> storeResult = shaderStorage->storeShader(name, shader);
+    CallResult<ShaderCompileStats> storeResult = shaderStorage->storeShader(name, shader);
     if (!storeResult.hasError()) {
-        animationManager->scheduleReload();
-        request->send(200);
+        animationManager->shaderChanged(name);
+
+        ShaderCompileStats stats = storeResult.getValue();
+        DynamicJsonDocument json(200);
+        json["sourceLoadMicros"] = stats.sourceLoadMicros;
+        json["bytecodeLoadMicros"] = stats.bytecodeLoadMicros;
+        json["bytecodeSize"] = stats.bytecodeSize;
+
+        String response;
+        serializeJson(json, response);
+        request->send(200, "application/json", response);
     } else {
         request->send(storeResult.getCode(), "text/plain", storeResult.getMessage());
     }
@@ -30,11 +39,16 @@ void ApiController::onListShaders(AsyncWebServerRequest *request) {
         return;
     }
     std::vector<String>* list = listResult.getValue();
-    uint16_t size = 100 + list->size() * 50;
+    uint16_t size = 100 + list->size() * 100;
     DynamicJsonDocument json(size);
     JsonArray names = json.createNestedArray("shader");
+    JsonObject memory = json.createNestedObject("memory");
     for(String str : *list) {
         names.add(str);
+        size_t usedBytes = animationManager->getShaderMemory(str);
+        if (usedBytes > 0) {
+            memory[str] = usedBytes;
+        }
     }
     delete list;
     
@@ -61,7 +75,7 @@ void ApiController::onGetShader(String& shader, AsyncWebServerRequest *request)
 
 void ApiController::onDeleteShader(String& shader, AsyncWebServerRequest *request) {
     if (shaderStorage->deleteShader(shader)) {
-        animationManager->scheduleReload();
+        animationManager->shaderRemoved(shader);
         request->send(200);
         return;
     } else {
@@ -70,13 +84,42 @@ void ApiController::onDeleteShader(String& shader, AsyncWebServerRequest *reques
     }
 }
 
+void ApiController::onSetSubsample(String& shader, AsyncWebServerRequest *request) {
+    if (!request->hasParam("factor")) {
+        request->send(400, "text/plain", "Missing factor");
+        return;
+    }
+    uint8_t factor = constrain(request->getParam("factor")->value().toInt(), 0, SUBSAMPLE_MAX);
+
+    DynamicJsonDocument json(100);
+    json["subsample"] = animationManager->setSubsample(shader, factor);
+
+    String response;
+    serializeJson(json, response);
+    request->send(200, "application/json", response);
+}
+
 void ApiController::onShow(String& shader, AsyncWebServerRequest *request) {
-    CallResult<void*> result = animationManager->select(shader);
+    RenderSettings settings = animationManager->getSettings();
+    Transition transition(settings.transition, settings.transitionMillis);
+    if (request->hasParam("transition")) {
+        CallResult<TransitionType> typeResult = Transition::typeFromName(request->getParam("transition")->value());
+        if (typeResult.hasError()) {
+            request->send(typeResult.getCode(), "text/plain", typeResult.getMessage());
+            return;
+        }
+        transition.type = typeResult.getValue();
+    }
+    if (request->hasParam("millis")) {
+        transition.durationMillis = constrain(request->getParam("millis")->value().toInt(), 0, TRANSITION_MAX_MILLIS);
+    }
+
+    CallResult<void*> result = animationManager->select(shader, transition);
     if (result.hasError()) {
         request->send(result.getCode(), "text/plain", result.getMessage());
         return;
     }
-    request->send(200);
+    request->send(result.getCode());
 }
 
 void ApiController::onGetShow(AsyncWebServerRequest *request) {
@@ -89,3 +132,222 @@ void ApiController::onGetShow(AsyncWebServerRequest *request) {
     serializeJson(json, response);
     request->send(200, "application/json", response);
 }
+
+void ApiController::onGetStats(AsyncWebServerRequest *request) {
+    RenderStats& stats = animationManager->getStats();
+    DynamicJsonDocument json(768);
+    json["renderFps"] = stats.renderFps;
+    json["outputFps"] = stats.outputFps;
+    json["renderMicros"] = stats.renderMicros;
+    json["showMicros"] = stats.showMicros;
+    json["requestedMilliamps"] = stats.requestedMilliamps;
+    json["milliamps"] = stats.milliamps;
+    json["powerLimitedFrames"] = stats.powerLimitedFrames;
+    json["frameAllocations"] = stats.frameAllocations;
+    json["luaBytes"] = stats.luaBytes;
+    json["luaPoolBytes"] = stats.luaPoolBytes;
+    json["sharedStateBytes"] = stats.sharedStateBytes;
+    json["gcMicros"] = stats.gcMicros;
+    json["gcFullCollections"] = stats.gcFullCollections;
+    json["budgetOverruns"] = stats.budgetOverruns;
+    json["quarantined"] = stats.quarantined;
+    json["transitioning"] = stats.transitioning;
+    json["parallel"] = stats.parallel;
+    json["skippedFrames"] = stats.skippedFrames;
+    json["timeInvariant"] = stats.timeInvariant;
+    json["cacheBytes"] = stats.cacheBytes;
+    json["cacheHits"] = stats.cacheHits;
+    json["cacheMisses"] = stats.cacheMisses;
+    json["cacheEvictions"] = stats.cacheEvictions;
+    json["lowMemoryEvictions"] = stats.lowMemoryEvictions;
+    json["loadMicros"] = stats.loadMicros;
+    json["loadedFromBytecode"] = stats.loadedFromBytecode;
+    json["switchMicros"] = stats.switchMicros;
+    json["preloads"] = stats.preloads;
+
+    String response;
+    serializeJson(json, response);
+    request->send(200, "application/json", response);
+}
+
+void ApiController::onBenchmarkFx(AsyncWebServerRequest *request) {
+    int frames = 20;
+    if (request->hasParam("frames")) {
+        frames = constrain(request->getParam("frames")->value().toInt(), 1, FX_BENCHMARK_MAX_FRAMES);
+    }
+
+    CallResult<void*> result = animationManager->startFxBenchmark(frames);
+    request->send(result.getCode(), "text/plain", result.getMessage());
+}
+
+void ApiController::onGetBenchmarkFx(AsyncWebServerRequest *request) {
+    CallResult<FxBenchmark> result = animationManager->getFxBenchmark();
+    if (result.getCode() != 200) {
+        request->send(result.getCode(), "text/plain", result.getMessage());
+        return;
+    }
+
+    FxBenchmark benchmark = result.getValue();
+    DynamicJsonDocument json(200);
+    json["frames"] = benchmark.frames;
+    json["pixels"] = benchmark.pixels;
+    json["fxMicros"] = benchmark.fxMicros;
+    json["floatMicros"] = benchmark.floatMicros;
+
+    String response;
+    serializeJson(json, response);
+    request->send(200, "application/json", response);
+}
+
+void ApiController::onGetSettings(AsyncWebServerRequest *request) {
+    RenderSettings settings = animationManager->getSettings();
+    DynamicJsonDocument json(768);
+    json["shaderMemoryCap"] = settings.shaderMemoryCap;
+    json["cacheMemoryBytes"] = settings.cacheMemoryBytes;
+    json["preload"] = settings.preload;
+    json["sharedState"] = settings.sharedState;
+    json["sharedStateMemoryCap"] = settings.sharedStateMemoryCap;
+    json["gcStepBudgetMicros"] = settings.gcStepBudgetMicros;
+    json["gcStepKb"] = settings.gcStepKb;
+    json["gcPause"] = settings.gcPause;
+    json["gcStepMul"] = settings.gcStepMul;
+    json["gcPressurePercent"] = settings.gcPressurePercent;
+    json["frameBudgetInstructions"] = settings.frameBudgetInstructions;
+    json["frameBudgetMicros"] = settings.frameBudgetMicros;
+    json["loadBudgetInstructions"] = settings.loadBudgetInstructions;
+    json["loadBudgetMicros"] = settings.loadBudgetMicros;
+    json["quarantineOverruns"] = settings.quarantineOverruns;
+    json["targetFps"] = settings.targetFps;
+    json["keyframeFps"] = settings.keyframeFps;
+    json["speed"] = settings.speed;
+    json["parallel"] = settings.parallel;
+    json["brightness"] = settings.brightness;
+    json["gamma"] = settings.gamma;
+    json["correction"] = settings.correction;
+    json["brightnessFadeMillis"] = settings.brightnessFadeMillis;
+    json["powerBudgetMilliamps"] = settings.powerBudgetMilliamps;
+    json["transition"] = Transition::typeName(settings.transition);
+    json["transitionMillis"] = settings.transitionMillis;
+
+    String response;
+    serializeJson(json, response);
+    request->send(200, "application/json", response);
+}
+
+void ApiController::onSetSettings(AsyncWebServerRequest *request, JsonVariant &json) {
+    RenderSettings settings = animationManager->getSettings();
+    // a rejected request changes nothing
+    String error;
+    bool valid = readMemoryCap(json, "shaderMemoryCap", settings.shaderMemoryCap, error)
+        && readMemoryCap(json, "cacheMemoryBytes", settings.cacheMemoryBytes, error)
+        && readMemoryCap(json, "sharedStateMemoryCap", settings.sharedStateMemoryCap, error)
+        && readSetting(json, "gcStepBudgetMicros", 0, GC_STEP_BUDGET_MAX, settings.gcStepBudgetMicros, error)
+        && readSetting(json, "gcStepKb", 0, GC_STEP_KB_MAX, settings.gcStepKb, error)
+        && readSetting(json, "gcPause", GC_PAUSE_MIN, GC_PAUSE_MAX, settings.gcPause, error)
+        && readSetting(json, "gcStepMul", GC_STEP_MUL_MIN, GC_STEP_MUL_MAX, settings.gcStepMul, error)
+        && readSetting(json, "gcPressurePercent", 1, 100, settings.gcPressurePercent, error)
+        && readSetting(json, "frameBudgetInstructions", 0, UINT32_MAX, settings.frameBudgetInstructions, error)
+        && readSetting(json, "frameBudgetMicros", 0, UINT32_MAX, settings.frameBudgetMicros, error)
+        && readSetting(json, "loadBudgetInstructions", 0, UINT32_MAX, settings.loadBudgetInstructions, error)
+        && readSetting(json, "loadBudgetMicros", 0, UINT32_MAX, settings.loadBudgetMicros, error)
+        && readSetting(json, "quarantineOverruns", 0, UINT8_MAX, settings.quarantineOverruns, error)
+        && readSetting(json, "targetFps", 0, FPS_MAX, settings.targetFps, error)
+        && readSetting(json, "keyframeFps", 0, FPS_MAX, settings.keyframeFps, error)
+        && readSetting(json, "speed", 0, SPEED_MAX, settings.speed, error)
+        && readSetting(json, "brightness", 0, 255, settings.brightness, error)
+        && readSetting(json, "gamma", GAMMA_MIN, GAMMA_MAX, settings.gamma, error)
+        && readSetting(json, "correction", 0, 0xFFFFFF, settings.correction, error)
+        && readSetting(json, "brightnessFadeMillis", 0, FADE_MILLIS_MAX, settings.brightnessFadeMillis, error)
+        && readSetting(json, "powerBudgetMilliamps", 0, UINT32_MAX, settings.powerBudgetMilliamps, error)
+        && readSetting(json, "transitionMillis", 0, TRANSITION_MAX_MILLIS, settings.transitionMillis, error);
+    if (valid && !json["transition"].isNull()) {
+        CallResult<TransitionType> typeResult = Transition::typeFromName(json["transition"].as<String>());
+        valid = !typeResult.hasError();
+        error = typeResult.getMessage();
+        settings.transition = typeResult.getValue();
+    }
+    if (!valid) {
+        request->send(400, "text/plain", error);
+        return;
+    }
+    if (!json["preload"].isNull()) {
+        settings.preload = json["preload"].as<bool>();
+    }
+    if (!json["sharedState"].isNull()) {
+        settings.sharedState = json["sharedState"].as<bool>();
+    }
+    if (!json["parallel"].isNull()) {
+        settings.parallel = json["parallel"].as<bool>();
+    }
+    animationManager->updateSettings(settings);
+    onGetSettings(request);
+}
+
+// copies a whole number within min and max, false with the reason in error otherwise
+template <typename T>
+bool ApiController::readSetting(JsonVariant &json, const char* key, double min, double max, T& setting, String& error) {
+    JsonVariant value = json[key];
+    if (value.isNull()) {
+        return true;
+    }
+    double number = value.as<double>();
+    if (!value.is<double>() || number < min || number > max || number != (double) (int64_t) number) {
+        error = String(key) + " must be a whole number from " + String((long) min) + " to " + String((unsigned long) max);
+        return false;
+    }
+    setting = (T) number;
+    return true;
+}
+
+bool ApiController::readMemoryCap(JsonVariant &json, const char* key, size_t& setting, String& error) {
+    size_t cap = setting;
+    if (!readSetting(json, key, 0, UINT32_MAX, cap, error)) {
+        return false;
+    }
+    if (cap != 0 && cap < MEMORY_CAP_MIN) {
+        error = String(key) + " must be 0 or at least " + String(MEMORY_CAP_MIN);
+        return false;
+    }
+    setting = cap;
+    return true;
+}
+
+void ApiController::onGetOutputs(AsyncWebServerRequest *request) {
+    DynamicJsonDocument json(128 + LED_OUTPUTS_MAX * 96);
+    LedOutputs::toJson(animationManager->getOutputs(), json.to<JsonArray>());
+
+    String response;
+    serializeJson(json, response);
+    request->send(200, "application/json", response);
+}
+
+void ApiController::onSetOutputs(AsyncWebServerRequest *request, JsonVariant &json) {
+    CallResult<std::vector<LedOutput>> outputsResult = LedOutputs::fromJson(json.as<JsonArrayConst>());
+    if (outputsResult.hasError()) {
+        request->send(outputsResult.getCode(), "text/plain", outputsResult.getMessage());
+        return;
+    }
+    std::vector<LedOutput> outputs = outputsResult.getValue();
+
+    DynamicJsonDocument savedJson(128 + LED_OUTPUTS_MAX * 96);
+    LedOutputs::toJson(outputs, savedJson.to<JsonArray>());
+    String saved;
+    serializeJson(savedJson, saved);
+    CallResult<void*> result = animationManager->reconfigure(outputs);
+    if (result.getCode() == 409) {
+        shaderStorage->saveOutputs(saved);
+        restartRequested = true;
+        request->send(202, "text/plain", "Outputs saved, restarting");
+        return;
+    }
+    if (result.hasError()) {
+        request->send(result.getCode(), "text/plain", result.getMessage());
+        return;
+    }
+    shaderStorage->saveOutputs(saved);
+    onGetOutputs(request);
+}
+
+bool ApiController::isRestartRequested() {
+    return restartRequested;
+}
@@ -0,0 +1,30 @@
+#include "FrameBuffers.h"
+
+FrameBuffers::FrameBuffers(size_t size) : size(size), middle(2) {
+    for (int i = 0; i < 3; i++) {
+        buffers[i] = new CRGB[size]();
+    }
+}
+
+FrameBuffers::~FrameBuffers() {
+    for (int i = 0; i < 3; i++) {
+        delete[] buffers[i];
+    }
+}
+
+void FrameBuffers::publish(const CRGB *frame) {
+    memcpy(buffers[back], frame, size * sizeof(CRGB));
+    back = middle.exchange(back | FRESH) & ~FRESH;
+}
+
+CRGB* FrameBuffers::acquire() {
+    if ((middle.load() & FRESH) == 0) {
+        return nullptr;
+    }
+    front = middle.exchange(front) & ~FRESH;
+    return buffers[front];
+}
+
+size_t FrameBuffers::getSize() {
+    return size;
+}
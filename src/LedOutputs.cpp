@@ -0,0 +1,217 @@
+#include "LedOutputs.h"
+
+// esp32 gpios able to drive a strip, flash, input only and sd card spi pins left out
+#define LED_OUTPUT_PINS(X) \
+    X(2) X(4) X(12) X(13) X(14) X(15) X(16) X(17) \
+    X(21) X(22) X(25) X(26) X(27) X(32) X(33)
+
+static const EOrder orders[] = {RGB, RBG, GRB, GBR, BRG, BGR};
+static const LedChipset chipsets[] = {CHIPSET_WS2812B, CHIPSET_WS2811, CHIPSET_SK6812};
+
+// every controller registered since boot, FastLED keeps them all
+class RegisteredController
+{
+public:
+    uint8_t pin;
+    LedChipset chipset;
+    CLEDController* controller;
+};
+
+static std::vector<RegisteredController> registeredControllers;
+
+LedOutput::LedOutput(uint8_t pin, uint16_t length, EOrder order, LedChipset chipset) {
+    LedOutput::pin = pin;
+    LedOutput::length = length;
+    LedOutput::order = order;
+    LedOutput::chipset = chipset;
+}
+
+template <uint8_t PIN>
+static CLEDController* addLeds(LedChipset chipset, CRGB* data, int length) {
+    switch (chipset) {
+        case CHIPSET_WS2811:
+            return &FastLED.addLeds<WS2811, PIN, RGB>(data, length);
+        case CHIPSET_SK6812:
+            return &FastLED.addLeds<SK6812, PIN, RGB>(data, length);
+        default:
+            return &FastLED.addLeds<WS2812B, PIN, RGB>(data, length);
+    }
+}
+
+CLEDController* LedOutputs::addController(uint8_t pin, LedChipset chipset, CRGB* data, int length) {
+#define LED_OUTPUT_ADD(PIN) case PIN: return addLeds<PIN>(chipset, data, length);
+    switch (pin) {
+        LED_OUTPUT_PINS(LED_OUTPUT_ADD)
+        default:
+            return nullptr;
+    }
+#undef LED_OUTPUT_ADD
+}
+
+bool LedOutputs::isPinSupported(uint8_t pin) {
+#define LED_OUTPUT_SUPPORTED(PIN) case PIN: return true;
+    switch (pin) {
+        LED_OUTPUT_PINS(LED_OUTPUT_SUPPORTED)
+        default:
+            return false;
+    }
+#undef LED_OUTPUT_SUPPORTED
+}
+
+CallResult<void*> LedOutputs::validate(std::vector<LedOutput>& outputs) {
+    if (outputs.empty() || outputs.size() > LED_OUTPUTS_MAX) {
+        return CallResult<void*>(nullptr, 400, "From 1 to %d outputs are supported, got %d", LED_OUTPUTS_MAX, outputs.size());
+    }
+    size_t total = totalLength(outputs);
+    if (total > LED_TOTAL_MAX) {
+        return CallResult<void*>(nullptr, 400, "Up to %d leds are supported, got %d", LED_TOTAL_MAX, total);
+    }
+    for (size_t i = 0; i < outputs.size(); i++) {
+        LedOutput& output = outputs[i];
+        if (!isPinSupported(output.pin)) {
+            return CallResult<void*>(nullptr, 400, "Pin %d can not drive a strip", output.pin);
+        }
+        if (output.length == 0) {
+            return CallResult<void*>(nullptr, 400, "Output on pin %d has no leds", output.pin);
+        }
+        for (size_t j = 0; j < i; j++) {
+            if (outputs[j].pin == output.pin) {
+                return CallResult<void*>(nullptr, 400, "Pin %d is used by two outputs", output.pin);
+            }
+        }
+    }
+    return CallResult<void*>(nullptr, 200);
+}
+
+size_t LedOutputs::totalLength(std::vector<LedOutput>& outputs) {
+    size_t length = 0;
+    for (auto& output : outputs) {
+        length += output.length;
+    }
+    return length;
+}
+
+CallResult<void*> LedOutputs::addControllers(std::vector<LedOutput>& outputs, CRGB* wire) {
+    CallResult<void*> validation = validate(outputs);
+    if (validation.hasError()) {
+        return validation;
+    }
+    if (!canAddControllers(outputs)) {
+        return CallResult<void*>(nullptr, 409, "Chipset of a driven pin changes only after reboot");
+    }
+
+    for (auto& registered : registeredControllers) {
+        registered.controller->setLeds(wire, 0);
+    }
+    size_t offset = 0;
+    for (auto& output : outputs) {
+        CLEDController* controller = nullptr;
+        for (auto& registered : registeredControllers) {
+            if (registered.pin == output.pin) {
+                controller = registered.controller;
+                controller->setLeds(wire + offset, output.length);
+            }
+        }
+        if (controller == nullptr) {
+            controller = addController(output.pin, output.chipset, wire + offset, output.length);
+            RegisteredController registered;
+            registered.pin = output.pin;
+            registered.chipset = output.chipset;
+            registered.controller = controller;
+            registeredControllers.push_back(registered);
+        }
+        // correction is part of post processing
+        controller->setCorrection(UncorrectedColor);
+        offset += output.length;
+    }
+    return CallResult<void*>(nullptr, 200);
+}
+
+bool LedOutputs::canAddControllers(std::vector<LedOutput>& outputs) {
+    for (auto& output : outputs) {
+        for (auto& registered : registeredControllers) {
+            if (registered.pin == output.pin && registered.chipset != output.chipset) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+CallResult<std::vector<LedOutput>> LedOutputs::fromJson(JsonArrayConst json) {
+    std::vector<LedOutput> outputs;
+    for (JsonObjectConst item : json) {
+        if (!item["pin"].is<int>() || !item["length"].is<int>()) {
+            return CallResult<std::vector<LedOutput>>(outputs, 400, "Output needs a pin and a length");
+        }
+        // checked before narrowing, pin 288 would pass as 32
+        int pin = item["pin"].as<int>();
+        if (pin < 0 || pin > 0xFF || !isPinSupported(pin)) {
+            return CallResult<std::vector<LedOutput>>(outputs, 400, "Pin %d can not drive a strip", pin);
+        }
+        LedOutput output(pin, constrain(item["length"].as<int>(), 0, 0xFFFF));
+
+        if (!item["order"].isNull()) {
+            const char* name = item["order"].as<const char*>();
+            bool found = false;
+            for (EOrder order : orders) {
+                if (name != nullptr && strcmp(name, orderName(order)) == 0) {
+                    output.order = order;
+                    found = true;
+                }
+            }
+            if (!found) {
+                return CallResult<std::vector<LedOutput>>(outputs, 400, "Unknown color order %s", name);
+            }
+        }
+        if (!item["chipset"].isNull()) {
+            const char* name = item["chipset"].as<const char*>();
+            bool found = false;
+            for (LedChipset chipset : chipsets) {
+                if (name != nullptr && strcmp(name, chipsetName(chipset)) == 0) {
+                    output.chipset = chipset;
+                    found = true;
+                }
+            }
+            if (!found) {
+                return CallResult<std::vector<LedOutput>>(outputs, 400, "Unknown chipset %s", name);
+            }
+        }
+        outputs.push_back(output);
+    }
+
+    CallResult<void*> validation = validate(outputs);
+    if (validation.hasError()) {
+        return CallResult<std::vector<LedOutput>>(outputs, validation.getCode(), validation.getMessage().c_str());
+    }
+    return CallResult<std::vector<LedOutput>>(outputs);
+}
+
+void LedOutputs::toJson(std::vector<LedOutput>& outputs, JsonArray json) {
+    for (auto& output : outputs) {
+        JsonObject item = json.createNestedObject();
+        item["pin"] = output.pin;
+        item["length"] = output.length;
+        item["order"] = orderName(output.order);
+        item["chipset"] = chipsetName(output.chipset);
+    }
+}
+
+const char* LedOutputs::orderName(EOrder order) {
+    switch (order) {
+        case RBG: return "RBG";
+        case GRB: return "GRB";
+        case GBR: return "GBR";
+        case BRG: return "BRG";
+        case BGR: return "BGR";
+        default: return "RGB";
+    }
+}
+
+const char* LedOutputs::chipsetName(LedChipset chipset) {
+    switch (chipset) {
+        case CHIPSET_WS2811: return "WS2811";
+        case CHIPSET_SK6812: return "SK6812";
+        default: return "WS2812B";
+    }
+}
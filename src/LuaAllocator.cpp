@@ -0,0 +1,164 @@
+#include "LuaAllocator.h"
+
+static const uint8_t poolClassSizes[LUA_POOL_CLASSES] = {16, 24, 32, 48, 64};
+// size class by (size - 1) / 8
+static const int8_t poolClassBySize[LUA_POOL_MAX_BLOCK / 8] = {0, 0, 1, 2, 3, 3, 4, 4};
+
+static void* poolFreeLists[LUA_POOL_CLASSES] = {};
+static size_t poolBytes = 0;
+// states on both cores share the pools, chunks are malloced outside of it
+static portMUX_TYPE poolLock = portMUX_INITIALIZER_UNLOCKED;
+
+LowMemoryHandler LuaAllocator::lowMemoryHandler = nullptr;
+
+void* LuaAllocator::alloc(void *ud, void *ptr, size_t osize, size_t nsize) {
+    LuaAllocator *allocator = (LuaAllocator*) ud;
+    // osize encodes the object type instead of a size when ptr is null
+    size_t oldSize = ptr == nullptr ? 0 : osize;
+    int oldClass = ptr == nullptr ? -1 : sizeClass(oldSize);
+
+    if (nsize == 0) {
+        if (oldClass >= 0) {
+            poolFree(ptr, oldClass);
+        } else {
+            free(ptr);
+        }
+        allocator->usedBytes -= oldSize;
+        return nullptr;
+    }
+
+    if (allocator->cap != 0 && nsize > oldSize && allocator->usedBytes + (nsize - oldSize) > allocator->cap) {
+        allocator->failures++;
+        return nullptr;
+    }
+
+    int newClass = sizeClass(nsize);
+    void *result = reallocate(ptr, oldSize, oldClass, nsize, newClass);
+    if (result == nullptr && lowMemoryHandler != nullptr && lowMemoryHandler(allocator, nsize) > 0) {
+        result = reallocate(ptr, oldSize, oldClass, nsize, newClass);
+    }
+
+    if (result == nullptr) {
+        allocator->failures++;
+        return nullptr;
+    }
+
+    allocator->usedBytes += nsize - oldSize;
+    allocator->allocations++;
+    if (allocator->usedBytes > allocator->peakBytes) {
+        allocator->peakBytes = allocator->usedBytes;
+    }
+    return result;
+}
+
+int LuaAllocator::sizeClass(size_t size) {
+    if (size == 0 || size > LUA_POOL_MAX_BLOCK) {
+        return -1;
+    }
+    return poolClassBySize[(size - 1) >> 3];
+}
+
+void* LuaAllocator::poolAlloc(int sizeClass) {
+    portENTER_CRITICAL(&poolLock);
+    void *block = poolFreeLists[sizeClass];
+    if (block != nullptr) {
+        poolFreeLists[sizeClass] = *(void**) block;
+    }
+    portEXIT_CRITICAL(&poolLock);
+    if (block != nullptr) {
+        return block;
+    }
+
+    uint8_t *chunk = (uint8_t*) malloc(LUA_POOL_CHUNK_SIZE);
+    if (chunk == nullptr) {
+        return nullptr;
+    }
+
+    // the first block is returned, the rest are chained and handed to the free list at once
+    size_t blockSize = poolClassSizes[sizeClass];
+    void *head = nullptr;
+    void *tail = nullptr;
+    for (size_t offset = blockSize; offset + blockSize <= LUA_POOL_CHUNK_SIZE; offset += blockSize) {
+        void *next = chunk + offset;
+        *(void**) next = head;
+        if (tail == nullptr) {
+            tail = next;
+        }
+        head = next;
+    }
+
+    portENTER_CRITICAL(&poolLock);
+    if (tail != nullptr) {
+        *(void**) tail = poolFreeLists[sizeClass];
+        poolFreeLists[sizeClass] = head;
+    }
+    poolBytes += LUA_POOL_CHUNK_SIZE;
+    portEXIT_CRITICAL(&poolLock);
+    return chunk;
+}
+
+void LuaAllocator::poolFree(void *ptr, int sizeClass) {
+    portENTER_CRITICAL(&poolLock);
+    *(void**) ptr = poolFreeLists[sizeClass];
+    poolFreeLists[sizeClass] = ptr;
+    portEXIT_CRITICAL(&poolLock);
+}
+
+// moves a block between the pools and the heap, the old block stays valid if this fails.
+// Lua takes shrinking as infallible, a shrink that can not move keeps the old block. It is bigger
+// than the new size and than any block of a smaller class, so it can go back to the pools when freed
+void* LuaAllocator::reallocate(void *ptr, size_t oldSize, int oldClass, size_t nsize, int newClass) {
+    if (ptr != nullptr && newClass >= 0 && newClass == oldClass) {
+        return ptr;
+    }
+    bool shrinking = ptr != nullptr && nsize < oldSize;
+    if (newClass < 0 && oldClass < 0) {
+        void *result = realloc(ptr, nsize);
+        return result == nullptr && shrinking ? ptr : result;
+    }
+    void *result = newClass >= 0 ? poolAlloc(newClass) : malloc(nsize);
+    if (result == nullptr && shrinking) {
+        return ptr;
+    }
+    if (result != nullptr && ptr != nullptr) {
+        memcpy(result, ptr, oldSize < nsize ? oldSize : nsize);
+        if (oldClass >= 0) {
+            poolFree(ptr, oldClass);
+        } else {
+            free(ptr);
+        }
+    }
+    return result;
+}
+
+void LuaAllocator::setLowMemoryHandler(LowMemoryHandler handler) {
+    lowMemoryHandler = handler;
+}
+
+size_t LuaAllocator::getPoolBytes() {
+    return poolBytes;
+}
+
+void LuaAllocator::setCap(size_t cap) {
+    LuaAllocator::cap = cap;
+}
+
+size_t LuaAllocator::getCap() {
+    return cap;
+}
+
+size_t LuaAllocator::getUsedBytes() {
+    return usedBytes;
+}
+
+size_t LuaAllocator::getPeakBytes() {
+    return peakBytes;
+}
+
+uint32_t LuaAllocator::getAllocations() {
+    return allocations;
+}
+
+uint32_t LuaAllocator::getFailures() {
+    return failures;
+}
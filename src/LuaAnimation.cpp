@@ -1,58 +1,369 @@
 #include "LuaAnimation.h"
 
-LuaAnimation::LuaAnimation(String& name) {
+static uint8_t toChannel(lua_State *L, int index) {
+    return lua_isinteger(L, index) ? lua_tointeger(L, index) : (lua_Integer) lua_tonumber(L, index);
+}
+
+LuaAnimation::LuaAnimation(String& name, LuaRuntime* sharedRuntime) {
     LuaAnimation::name = name;
-    luaState = luaL_newstate();
+    ownsRuntime = sharedRuntime == nullptr;
+    runtime = ownsRuntime ? new LuaRuntime() : sharedRuntime;
+    luaState = runtime->getState();
 }
 
 LuaAnimation::~LuaAnimation() {
-    lua_close(luaState);
+    delete pixelsRef;
+    delete frameFunc;
+    delete colorFunc;
+    delete environment;
+    if (ownsRuntime) {
+        delete runtime;
+    }
 }
 
-CallResult<void*> LuaAnimation::begin(String& shader, GlobalAnimationEnv* globalAnimationEnv) {
-    int loadShaderCode = luaL_dostring(luaState, shader.c_str());
+CallResult<void*> LuaAnimation::begin(String& shader, std::vector<uint8_t>* bytecode, GlobalAnimationEnv* globalAnimationEnv) {
+    if (ownsRuntime) {
+        CallResult<void*> runtimeResult = runtime->begin(globalAnimationEnv);
+        if (runtimeResult.hasError()) {
+            return runtimeResult;
+        }
+    }
+    size_t bytesBefore = runtime->getAllocator().getUsedBytes();
+
+    if (ownsRuntime) {
+        lua_pushglobaltable(luaState);
+    } else {
+        // own globals falling back to the shared libraries, _G points to the shader's own table
+        lua_newtable(luaState);
+        lua_newtable(luaState);
+        lua_pushglobaltable(luaState);
+        lua_setfield(luaState, -2, "__index");
+        lua_setmetatable(luaState, -2);
+        lua_pushvalue(luaState, -1);
+        lua_setfield(luaState, -2, "_G");
+    }
+    environment = new LuaRefHolder(luaState);
+
+    LuaAnimation::globalAnimationEnv = globalAnimationEnv;
+    pixels = LuaPixels::push(luaState);
+    pixelsRef = new LuaRefHolder(luaState);
+
+    uint32_t start = micros();
+    String chunkName = "=" + name;
+    int loadShaderCode = LUA_ERRSYNTAX;
+    if (bytecode != nullptr) {
+        loadShaderCode = luaL_loadbufferx(luaState, (const char*) bytecode->data(), bytecode->size(), chunkName.c_str(), "b");
+        loadedFromBytecode = loadShaderCode == LUA_OK;
+        if (!loadedFromBytecode) {
+            Serial.printf("Bytecode of \"%s\" rejected, loading source: %s\n", name.c_str(), lua_tostring(luaState, -1));
+            lua_pop(luaState, 1);
+        }
+    }
+    if (!loadedFromBytecode) {
+        loadShaderCode = luaL_loadbufferx(luaState, shader.c_str(), shader.length(), chunkName.c_str(), "t");
+    }
     if (loadShaderCode) {
-        return CallResult<void*>(nullptr, 400, "Error loading code, lua message %d", loadShaderCode);
+        CallResult<void*> result(nullptr, 400, "Error loading code: %s", lua_tostring(luaState, -1));
+        lua_pop(luaState, 1);
+        return result;
     }
 
-    luaL_openlibs(luaState);
-    // int compileShaderCode = lua_pcall(luaState, 0, 0, 0);
-    // if (compileShaderCode) {
-    //     // return CallResult<void*>(nullptr, 400, "Error running code, lua message %d", compileShaderCode);
-    // }
+    // first upvalue of a main chunk is its _ENV
+    environment->push();
+    lua_setupvalue(luaState, -2, 1);
 
-    luabridge::getGlobalNamespace(luaState)
-        .beginNamespace("env")
-        .addProperty("millis", &(globalAnimationEnv->timeMillis), false)
-        .addProperty("iteration", &(globalAnimationEnv->iteration), false)
-        .endNamespace();
+    runtime->armBudget(loadBudgetInstructions, loadBudgetMicros);
+    int runShaderCode = lua_pcall(luaState, 0, 0, 0);
+    runtime->disarmBudget();
+    if (runShaderCode) {
+        CallResult<void*> result(nullptr, 400, "Error running code: %s", lua_tostring(luaState, -1));
+        lua_pop(luaState, 1);
+        return result;
+    }
+    loadMicros = micros() - start;
+
+    frameFunc = environmentFunction("frame");
+    colorFunc = environmentFunction("color");
+
+    environment->push();
+    lua_getfield(luaState, -1, "color_format");
+    rgbColors = lua_type(luaState, -1) == LUA_TSTRING && strcmp(lua_tostring(luaState, -1), "rgb") == 0;
+    lua_pop(luaState, 1);
+    lua_getfield(luaState, -1, "time_invariant");
+    timeInvariant = lua_toboolean(luaState, -1);
+    lua_pop(luaState, 1);
+    lua_getfield(luaState, -1, "subsample");
+    shaderSubsample = constrain(lua_tointeger(luaState, -1), 1, SUBSAMPLE_MAX);
+    if (subsampleOverride == 0) {
+        subsample = shaderSubsample;
+    }
+    lua_pop(luaState, 2);
+
+    sharedBytes = runtime->getAllocator().getUsedBytes() - bytesBefore;
     return CallResult<void*>(nullptr, 200);
 }
 
+void LuaAnimation::configureGc(bool scheduled, int pause, int stepMul) {
+    if (ownsRuntime) {
+        runtime->configureGc(scheduled, pause, stepMul);
+    }
+}
+
+bool LuaAnimation::collectGarbage(uint32_t deadlineMicros, int stepKb, bool underPressure) {
+    return runtime->collectGarbage(deadlineMicros, stepKb, underPressure);
+}
+
+void LuaAnimation::configureBudget(uint32_t frameInstructions, uint32_t frameMicros, uint32_t loadInstructions, uint32_t loadMicros, uint8_t quarantineOverruns) {
+    frameBudgetInstructions = frameInstructions;
+    frameBudgetMicros = frameMicros;
+    loadBudgetInstructions = loadInstructions;
+    loadBudgetMicros = loadMicros;
+    LuaAnimation::quarantineOverruns = quarantineOverruns;
+}
+
+bool LuaAnimation::isQuarantined() {
+    return quarantined;
+}
+
+uint32_t LuaAnimation::getBudgetOverruns() {
+    return budgetOverruns;
+}
+
 CallResult<void*> LuaAnimation::apply(CRGB *leds, size_t size) {
-    luabridge::LuaRef colorFunc = luabridge::LuaRef(luabridge::getGlobal(luaState, "color"));
-    if (colorFunc.isNil() || !colorFunc.isFunction()) {
-        return CallResult<void*>(nullptr, 400, "No shader function \"color(int) -> (int, int, int)\" is present in the code");
-    }
-
-    for (int i = 0; i < size; i++) {
-        luabridge::LuaRef ledColor = colorFunc(i);
-        if (ledColor.isNil()) {
-            // pixel is discarded, ignore
-        } 
-        else {
-            if (!ledColor.isTable()) {
-                return CallResult<void*>(nullptr, 400, "Shader function \"color(int)\" does not return a table");
+    return apply(leds, size, 0, size);
+}
+
+CallResult<void*> LuaAnimation::apply(CRGB *leds, size_t size, size_t from, size_t to) {
+    if (quarantined) {
+        return CallResult<void*>(nullptr, 503, "Shader \"%s\" is quarantined after %d budget overruns in a row", name.c_str(), consecutiveOverruns);
+    }
+
+    LuaAllocator& allocator = runtime->getAllocator();
+    uint32_t allocationsBefore = allocator.getAllocations();
+    CallResult<void*> result(nullptr, 200);
+    runtime->armBudget(frameBudgetInstructions, frameBudgetMicros);
+    if (frameFunc != nullptr) {
+        result = applyFrame(leds, size);
+    } else if (colorFunc != nullptr) {
+        result = applyColor(leds, size, from, to);
+    } else {
+        result = CallResult<void*>(nullptr, 400, "No shader function \"frame(pixels, n, t)\" or \"color(int) -> (int, int, int)\" is present in the code");
+    }
+    runtime->disarmBudget();
+    frameAllocations = allocator.getAllocations() - allocationsBefore;
+
+    if (runtime->isBudgetExceeded()) {
+        budgetOverruns++;
+        consecutiveOverruns++;
+        if (quarantineOverruns != 0 && consecutiveOverruns >= quarantineOverruns) {
+            Serial.printf("Shader \"%s\" quarantined: %s\n", name.c_str(), result.getMessage().c_str());
+            quarantined = true;
+        }
+    } else if (!result.hasError()) {
+        consecutiveOverruns = 0;
+    }
+    return result;
+}
+
+CallResult<void*> LuaAnimation::applyFrame(CRGB *leds, size_t size) {
+    pixels->leds = leds;
+    pixels->size = size;
+
+    frameFunc->push();
+    pixelsRef->push();
+    lua_pushinteger(luaState, size);
+    lua_pushinteger(luaState, globalAnimationEnv->timeMillis);
+    int callCode = lua_pcall(luaState, 3, 0, 0);
+    if (callCode) {
+        CallResult<void*> result(nullptr, 400, "Shader function \"frame(pixels, n, t)\" failed: %s", lua_tostring(luaState, -1));
+        lua_pop(luaState, 1);
+        return result;
+    }
+    return CallResult<void*>(nullptr, 200);
+}
+
+// color(i) may return {h, s, v}, h, s, v or a single packed 0xHHSSVV integer,
+// with color_format = "rgb" the same values are read as r, g, b
+CallResult<void*> LuaAnimation::applyColor(CRGB *leds, size_t size, size_t from, size_t to) {
+    uint8_t color[3];
+    if (subsample <= 1) {
+        for (size_t i = from; i < to; i++) {
+            CallResult<bool> sample = sampleColor(i, color);
+            if (sample.hasError()) {
+                return CallResult<void*>(nullptr, sample.getCode(), sample.getMessage().c_str());
+            }
+            if (sample.getValue()) {
+                leds[i] = toColor(color[0], color[1], color[2]);
+            }
+        }
+        return CallResult<void*>(nullptr, 200);
+    }
+    if (from >= to) {
+        return CallResult<void*>(nullptr, 200);
+    }
+
+    // samples sit on multiples of subsample and on the last pixel whatever the range,
+    // so a strip rendered in two halves gets the same pixels as rendered at once
+    size_t left = from / subsample * subsample;
+    uint8_t leftColor[3];
+    CallResult<bool> leftSample = sampleColor(left, leftColor);
+    if (leftSample.hasError()) {
+        return CallResult<void*>(nullptr, leftSample.getCode(), leftSample.getMessage().c_str());
+    }
+    while (left < to) {
+        if (left == size - 1) {
+            if (leftSample.getValue()) {
+                leds[left] = toColor(leftColor[0], leftColor[1], leftColor[2]);
+            }
+            break;
+        }
+        size_t right = left + subsample < size ? left + subsample : size - 1;
+        CallResult<bool> rightSample = sampleColor(right, color);
+        if (rightSample.hasError()) {
+            return CallResult<void*>(nullptr, rightSample.getCode(), rightSample.getMessage().c_str());
+        }
+
+        // gaps next to a discarded sample are left as they are
+        size_t last = right < to ? right : to;
+        for (size_t i = left > from ? left : from; i < last; i++) {
+            if (i == left && leftSample.getValue()) {
+                leds[i] = toColor(leftColor[0], leftColor[1], leftColor[2]);
             }
-            if (!ledColor[1].isNumber() || !ledColor[2].isNumber() || !ledColor[3].isNumber()) {
-                return CallResult<void*>(nullptr, 400, "Shader function \"color(int)\" returned table of not numbers");
+            else if (leftSample.getValue() && rightSample.getValue()) {
+                leds[i] = interpolate(leftColor, color, i - left, right - left);
             }
-            leds[i] = CHSV(ledColor[1].cast<int>(), ledColor[2].cast<int>(), ledColor[3].cast<int>());
         }
+
+        left = right;
+        memcpy(leftColor, color, sizeof(leftColor));
+        leftSample = rightSample;
     }
     return CallResult<void*>(nullptr, 200);
 }
 
+// calls color(i), false if the shader discarded the pixel
+CallResult<bool> LuaAnimation::sampleColor(size_t i, uint8_t *color) {
+    int top = lua_gettop(luaState);
+    colorFunc->push();
+    lua_pushinteger(luaState, i);
+    int callCode = lua_pcall(luaState, 1, 3, 0);
+    if (callCode) {
+        CallResult<bool> result(false, 400, "Shader function \"color(int)\" failed: %s", lua_tostring(luaState, -1));
+        lua_settop(luaState, top);
+        return result;
+    }
+
+    int firstType = lua_type(luaState, -3);
+    if (firstType == LUA_TNIL) {
+        // pixel is discarded, ignore
+        lua_settop(luaState, top);
+        return CallResult<bool>(false, 200);
+    }
+    else if (firstType == LUA_TTABLE) {
+        lua_rawgeti(luaState, -3, 1);
+        lua_rawgeti(luaState, -4, 2);
+        lua_rawgeti(luaState, -5, 3);
+        if (!lua_isnumber(luaState, -3) || !lua_isnumber(luaState, -2) || !lua_isnumber(luaState, -1)) {
+            lua_settop(luaState, top);
+            return CallResult<bool>(false, 400, "Shader function \"color(int)\" returned table of not numbers");
+        }
+        color[0] = toChannel(luaState, -3);
+        color[1] = toChannel(luaState, -2);
+        color[2] = toChannel(luaState, -1);
+    }
+    else if (firstType == LUA_TNUMBER && lua_type(luaState, -2) == LUA_TNIL) {
+        uint32_t packed = lua_isinteger(luaState, -3) ? lua_tointeger(luaState, -3) : (lua_Integer) lua_tonumber(luaState, -3);
+        color[0] = packed >> 16;
+        color[1] = packed >> 8;
+        color[2] = packed;
+    }
+    else if (firstType == LUA_TNUMBER && lua_isnumber(luaState, -2) && lua_isnumber(luaState, -1)) {
+        color[0] = toChannel(luaState, -3);
+        color[1] = toChannel(luaState, -2);
+        color[2] = toChannel(luaState, -1);
+    }
+    else {
+        lua_settop(luaState, top);
+        return CallResult<bool>(false, 400, "Shader function \"color(int)\" does not return a table, three numbers or a packed color");
+    }
+    lua_settop(luaState, top);
+    return CallResult<bool>(true, 200);
+}
+
+// channels are interpolated before conversion, hsv hue takes the short way round the circle
+CRGB LuaAnimation::interpolate(uint8_t *from, uint8_t *to, size_t step, size_t steps) {
+    int first = rgbColors ? (int) to[0] - from[0] : (int8_t) (to[0] - from[0]);
+    return toColor(
+        from[0] + first * (int) step / (int) steps,
+        from[1] + ((int) to[1] - from[1]) * (int) step / (int) steps,
+        from[2] + ((int) to[2] - from[2]) * (int) step / (int) steps);
+}
+
+void LuaAnimation::setSubsample(uint8_t factor) {
+    subsampleOverride = constrain(factor, 0, SUBSAMPLE_MAX);
+    subsample = subsampleOverride != 0 ? subsampleOverride : shaderSubsample;
+}
+
+uint8_t LuaAnimation::getSubsample() {
+    return subsample;
+}
+
+bool LuaAnimation::isTimeInvariant() {
+    return timeInvariant;
+}
+
+bool LuaAnimation::isPerPixel() {
+    return frameFunc == nullptr && colorFunc != nullptr;
+}
+
+CRGB LuaAnimation::toColor(uint8_t a, uint8_t b, uint8_t c) {
+    if (rgbColors) {
+        return CRGB(a, b, c);
+    }
+    return CHSV(a, b, c);
+}
+
+LuaRefHolder* LuaAnimation::environmentFunction(const char* functionName) {
+    environment->push();
+    lua_getfield(luaState, -1, functionName);
+    lua_remove(luaState, -2);
+    if (!lua_isfunction(luaState, -1)) {
+        lua_pop(luaState, 1);
+        return nullptr;
+    }
+    return new LuaRefHolder(luaState);
+}
+
 String LuaAnimation::getName() {
     return name;
 }
+
+LuaAllocator& LuaAnimation::getAllocator() {
+    return runtime->getAllocator();
+}
+
+size_t LuaAnimation::getUsedBytes() {
+    return ownsRuntime ? runtime->getAllocator().getUsedBytes() : sharedBytes;
+}
+
+size_t LuaAnimation::getPeakBytes() {
+    return ownsRuntime ? runtime->getAllocator().getPeakBytes() : sharedBytes;
+}
+
+void LuaAnimation::setMemoryCap(size_t cap) {
+    if (ownsRuntime) {
+        runtime->setMemoryCap(cap);
+    }
+}
+
+uint32_t LuaAnimation::getFrameAllocations() {
+    return frameAllocations;
+}
+
+uint32_t LuaAnimation::getLoadMicros() {
+    return loadMicros;
+}
+
+bool LuaAnimation::isLoadedFromBytecode() {
+    return loadedFromBytecode;
+}
@@ -0,0 +1,167 @@
+#include "LuaFx.h"
+#include "LuaRuntime.h"
+
+#ifdef LUA_USE_ROTABLES
+extern "C" {
+#include <lrotable.h>
+}
+#endif
+
+static uint8_t checkU8(lua_State *L, int arg) {
+    return (uint8_t) luaL_checkinteger(L, arg);
+}
+
+static uint16_t checkU16(lua_State *L, int arg) {
+    return (uint16_t) luaL_checkinteger(L, arg);
+}
+
+static int fxSin8(lua_State *L) {
+    lua_pushinteger(L, sin8(checkU8(L, 1)));
+    return 1;
+}
+
+static int fxCos8(lua_State *L) {
+    lua_pushinteger(L, cos8(checkU8(L, 1)));
+    return 1;
+}
+
+static int fxSin16(lua_State *L) {
+    lua_pushinteger(L, sin16(checkU16(L, 1)));
+    return 1;
+}
+
+// FastLED beat16 on shader time instead of wall time, so beats follow speed and env.millis
+static uint16_t envBeat16(lua_State *L, uint16_t bpm, uint32_t timebase) {
+    if (bpm < 256) {
+        bpm <<= 8;
+    }
+    return ((LuaRuntime::envOf(L)->timeMillis - timebase) * bpm * 280) >> 16;
+}
+
+// fx.beat8(bpm [, timebase])
+static int fxBeat8(lua_State *L) {
+    lua_pushinteger(L, envBeat16(L, checkU16(L, 1), (uint32_t) luaL_optinteger(L, 2, 0)) >> 8);
+    return 1;
+}
+
+// fx.beatsin8(bpm [, lowest, highest, timebase, phase])
+static int fxBeatsin8(lua_State *L) {
+    uint16_t bpm = checkU16(L, 1);
+    uint8_t lowest = (uint8_t) luaL_optinteger(L, 2, 0);
+    uint8_t highest = (uint8_t) luaL_optinteger(L, 3, 255);
+    uint32_t timebase = (uint32_t) luaL_optinteger(L, 4, 0);
+    uint8_t phase = (uint8_t) luaL_optinteger(L, 5, 0);
+    uint8_t beat = envBeat16(L, bpm, timebase) >> 8;
+    lua_pushinteger(L, lowest + scale8(sin8(beat + phase), highest - lowest));
+    return 1;
+}
+
+// fx.beatsin16(bpm [, lowest, highest, timebase, phase])
+static int fxBeatsin16(lua_State *L) {
+    uint16_t bpm = checkU16(L, 1);
+    uint16_t lowest = (uint16_t) luaL_optinteger(L, 2, 0);
+    uint16_t highest = (uint16_t) luaL_optinteger(L, 3, 65535);
+    uint32_t timebase = (uint32_t) luaL_optinteger(L, 4, 0);
+    uint16_t phase = (uint16_t) luaL_optinteger(L, 5, 0);
+    uint16_t beat = envBeat16(L, bpm, timebase);
+    lua_pushinteger(L, (uint16_t) (lowest + scale16(sin16(beat + phase) + 32768, highest - lowest)));
+    return 1;
+}
+
+// fx.inoise8(x [, y [, z]])
+static int fxInoise8(lua_State *L) {
+    uint16_t x = checkU16(L, 1);
+    switch (lua_gettop(L)) {
+        case 1: lua_pushinteger(L, inoise8(x)); break;
+        case 2: lua_pushinteger(L, inoise8(x, checkU16(L, 2))); break;
+        default: lua_pushinteger(L, inoise8(x, checkU16(L, 2), checkU16(L, 3))); break;
+    }
+    return 1;
+}
+
+// fx.inoise16(x [, y [, z]])
+static int fxInoise16(lua_State *L) {
+    uint32_t x = (uint32_t) luaL_checkinteger(L, 1);
+    switch (lua_gettop(L)) {
+        case 1: lua_pushinteger(L, inoise16(x)); break;
+        case 2: lua_pushinteger(L, inoise16(x, (uint32_t) luaL_checkinteger(L, 2))); break;
+        default: lua_pushinteger(L, inoise16(x, (uint32_t) luaL_checkinteger(L, 2), (uint32_t) luaL_checkinteger(L, 3))); break;
+    }
+    return 1;
+}
+
+// fx.random8([[min,] lim]), lim is exclusive
+static int fxRandom8(lua_State *L) {
+    switch (lua_gettop(L)) {
+        case 0: lua_pushinteger(L, random8()); break;
+        case 1: lua_pushinteger(L, random8(checkU8(L, 1))); break;
+        default: lua_pushinteger(L, random8(checkU8(L, 1), checkU8(L, 2))); break;
+    }
+    return 1;
+}
+
+// fx.random16([[min,] lim]), lim is exclusive
+static int fxRandom16(lua_State *L) {
+    switch (lua_gettop(L)) {
+        case 0: lua_pushinteger(L, random16()); break;
+        case 1: lua_pushinteger(L, random16(checkU16(L, 1))); break;
+        default: lua_pushinteger(L, random16(checkU16(L, 1), checkU16(L, 2))); break;
+    }
+    return 1;
+}
+
+static int fxScale8(lua_State *L) {
+    lua_pushinteger(L, scale8(checkU8(L, 1), checkU8(L, 2)));
+    return 1;
+}
+
+static int fxQadd8(lua_State *L) {
+    lua_pushinteger(L, qadd8(checkU8(L, 1), checkU8(L, 2)));
+    return 1;
+}
+
+static int fxLerp8by8(lua_State *L) {
+    lua_pushinteger(L, lerp8by8(checkU8(L, 1), checkU8(L, 2), checkU8(L, 3)));
+    return 1;
+}
+
+static int fxEase8InOutQuad(lua_State *L) {
+    lua_pushinteger(L, ease8InOutQuad(checkU8(L, 1)));
+    return 1;
+}
+
+static const luaL_Reg fxFunctions[] = {
+    {"sin8", fxSin8},
+    {"cos8", fxCos8},
+    {"sin16", fxSin16},
+    {"beat8", fxBeat8},
+    {"beatsin8", fxBeatsin8},
+    {"beatsin16", fxBeatsin16},
+    {"inoise8", fxInoise8},
+    {"inoise16", fxInoise16},
+    {"random8", fxRandom8},
+    {"random16", fxRandom16},
+    {"scale8", fxScale8},
+    {"qadd8", fxQadd8},
+    {"lerp8by8", fxLerp8by8},
+    {"ease8InOutQuad", fxEase8InOutQuad},
+    {NULL, NULL}
+};
+
+#ifdef LUA_USE_ROTABLES
+static const luaR_table fxRotable = {LUA_FX_LIBNAME, fxFunctions, NULL};
+#endif
+
+static int openFx(lua_State *L) {
+#ifdef LUA_USE_ROTABLES
+    lua_pushrotable(L, &fxRotable);
+#else
+    luaL_newlib(L, fxFunctions);
+#endif
+    return 1;
+}
+
+void LuaFx::registerLib(lua_State *L) {
+    luaL_requiref(L, LUA_FX_LIBNAME, openFx, 1);
+    lua_pop(L, 1);
+}
@@ -0,0 +1,87 @@
+#include "LuaPixels.h"
+
+static lua_Integer checkPixelIndex(lua_State *L, LuaPixels *pixels, int arg) {
+    lua_Integer i = luaL_checkinteger(L, arg);
+    luaL_argcheck(L, i >= 0 && (size_t) i < pixels->size, arg, "pixel index out of range");
+    return i;
+}
+
+static uint8_t checkChannel(lua_State *L, int arg) {
+    return (uint8_t) luaL_checkinteger(L, arg);
+}
+
+static int pixelsIndex(lua_State *L) {
+    LuaPixels *pixels = LuaPixels::check(L, 1);
+    if (lua_type(L, 2) == LUA_TNUMBER) {
+        lua_Integer i = checkPixelIndex(L, pixels, 2);
+        CRGB &led = pixels->leds[i];
+        lua_pushinteger(L, ((lua_Integer) led.r << 16) | ((lua_Integer) led.g << 8) | led.b);
+        return 1;
+    }
+    lua_pushvalue(L, 2);
+    lua_rawget(L, lua_upvalueindex(1));
+    return 1;
+}
+
+static int pixelsNewIndex(lua_State *L) {
+    LuaPixels *pixels = LuaPixels::check(L, 1);
+    lua_Integer i = checkPixelIndex(L, pixels, 2);
+    pixels->leds[i] = CRGB((uint32_t) luaL_checkinteger(L, 3));
+    return 0;
+}
+
+static int pixelsLen(lua_State *L) {
+    lua_pushinteger(L, LuaPixels::check(L, 1)->size);
+    return 1;
+}
+
+static int pixelsSetHsv(lua_State *L) {
+    LuaPixels *pixels = LuaPixels::check(L, 1);
+    lua_Integer i = checkPixelIndex(L, pixels, 2);
+    pixels->leds[i] = CHSV(checkChannel(L, 3), checkChannel(L, 4), checkChannel(L, 5));
+    return 0;
+}
+
+static int pixelsSetRgb(lua_State *L) {
+    LuaPixels *pixels = LuaPixels::check(L, 1);
+    lua_Integer i = checkPixelIndex(L, pixels, 2);
+    pixels->leds[i] = CRGB(checkChannel(L, 3), checkChannel(L, 4), checkChannel(L, 5));
+    return 0;
+}
+
+static const luaL_Reg pixelsMethods[] = {
+    {"set_hsv", pixelsSetHsv},
+    {"set_rgb", pixelsSetRgb},
+    {NULL, NULL}
+};
+
+void LuaPixels::registerType(lua_State *L) {
+    if (!luaL_newmetatable(L, LUA_PIXELS_TYPE)) {
+        lua_pop(L, 1);
+        return;
+    }
+
+    luaL_newlib(L, pixelsMethods);
+    lua_pushcclosure(L, pixelsIndex, 1);
+    lua_setfield(L, -2, "__index");
+
+    lua_pushcfunction(L, pixelsNewIndex);
+    lua_setfield(L, -2, "__newindex");
+
+    lua_pushcfunction(L, pixelsLen);
+    lua_setfield(L, -2, "__len");
+
+    lua_pop(L, 1);
+}
+
+LuaPixels* LuaPixels::push(lua_State *L) {
+    LuaPixels *pixels = (LuaPixels*) lua_newuserdata(L, sizeof(LuaPixels));
+    pixels->leds = nullptr;
+    pixels->size = 0;
+    luaL_setmetatable(L, LUA_PIXELS_TYPE);
+    return pixels;
+}
+
+LuaPixels* LuaPixels::check(lua_State *L, int index) {
+    return (LuaPixels*) luaL_checkudata(L, index, LUA_PIXELS_TYPE);
+}
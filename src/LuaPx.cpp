@@ -0,0 +1,151 @@
+#include "LuaPx.h"
+
+#ifdef LUA_USE_ROTABLES
+extern "C" {
+#include <lrotable.h>
+}
+#endif
+
+static void checkRange(lua_State *L, LuaPixels *pixels, int arg, size_t &from, size_t &count) {
+    lua_Integer f = luaL_optinteger(L, arg, 0);
+    luaL_argcheck(L, f >= 0 && (size_t) f <= pixels->size, arg, "range start out of range");
+    lua_Integer c = luaL_optinteger(L, arg + 1, pixels->size - f);
+    luaL_argcheck(L, c >= 0 && (size_t) c <= pixels->size - f, arg + 1, "range count out of range");
+    from = f;
+    count = c;
+}
+
+static CHSV toHsv(lua_Integer packed) {
+    return CHSV((uint8_t) (packed >> 16), (uint8_t) (packed >> 8), (uint8_t) packed);
+}
+
+// px.fill(pixels, rgb [, from, count])
+static int pxFill(lua_State *L) {
+    LuaPixels *pixels = LuaPixels::check(L, 1);
+    CRGB color((uint32_t) luaL_checkinteger(L, 2));
+    size_t from, count;
+    checkRange(L, pixels, 3, from, count);
+    fill_solid(pixels->leds + from, count, color);
+    return 0;
+}
+
+// px.gradient_hsv(pixels, hsvStart, hsvEnd [, from, count]), hues go the shortest way around
+static int pxGradientHsv(lua_State *L) {
+    LuaPixels *pixels = LuaPixels::check(L, 1);
+    CHSV start = toHsv(luaL_checkinteger(L, 2));
+    CHSV end = toHsv(luaL_checkinteger(L, 3));
+    size_t from, count;
+    checkRange(L, pixels, 4, from, count);
+    if (count > 0) {
+        fill_gradient(pixels->leds, from, start, from + count - 1, end, SHORTEST_HUES);
+    }
+    return 0;
+}
+
+// px.fade_to_black(pixels, amount [, from, count])
+static int pxFadeToBlack(lua_State *L) {
+    LuaPixels *pixels = LuaPixels::check(L, 1);
+    uint8_t amount = (uint8_t) luaL_checkinteger(L, 2);
+    size_t from, count;
+    checkRange(L, pixels, 3, from, count);
+    fadeToBlackBy(pixels->leds + from, count, amount);
+    return 0;
+}
+
+// px.blur1d(pixels, amount [, from, count])
+static int pxBlur1d(lua_State *L) {
+    LuaPixels *pixels = LuaPixels::check(L, 1);
+    uint8_t amount = (uint8_t) luaL_checkinteger(L, 2);
+    size_t from, count;
+    checkRange(L, pixels, 3, from, count);
+    blur1d(pixels->leds + from, count, amount);
+    return 0;
+}
+
+// px.shift(pixels, by [, from, count]), positive towards higher indices, vacated pixels turn black
+static int pxShift(lua_State *L) {
+    LuaPixels *pixels = LuaPixels::check(L, 1);
+    lua_Integer by = luaL_checkinteger(L, 2);
+    size_t from, count;
+    checkRange(L, pixels, 3, from, count);
+    CRGB *leds = pixels->leds + from;
+    size_t distance = by < 0 ? -by : by;
+    if (distance >= count) {
+        fill_solid(leds, count, CRGB::Black);
+    } else if (by > 0) {
+        memmove(leds + distance, leds, (count - distance) * sizeof(CRGB));
+        fill_solid(leds, distance, CRGB::Black);
+    } else if (by < 0) {
+        memmove(leds, leds + distance, (count - distance) * sizeof(CRGB));
+        fill_solid(leds + count - distance, distance, CRGB::Black);
+    }
+    return 0;
+}
+
+// px.mirror(pixels [, from, count]), the first half of the range is reflected onto the second
+static int pxMirror(lua_State *L) {
+    LuaPixels *pixels = LuaPixels::check(L, 1);
+    size_t from, count;
+    checkRange(L, pixels, 2, from, count);
+    CRGB *leds = pixels->leds + from;
+    for (size_t i = 0; i < count / 2; i++) {
+        leds[count - 1 - i] = leds[i];
+    }
+    return 0;
+}
+
+// px.copy_range(pixels, src, dst, count), ranges may overlap
+static int pxCopyRange(lua_State *L) {
+    LuaPixels *pixels = LuaPixels::check(L, 1);
+    lua_Integer src = luaL_checkinteger(L, 2);
+    lua_Integer dst = luaL_checkinteger(L, 3);
+    lua_Integer count = luaL_checkinteger(L, 4);
+    luaL_argcheck(L, src >= 0 && (size_t) src <= pixels->size, 2, "range start out of range");
+    luaL_argcheck(L, dst >= 0 && (size_t) dst <= pixels->size, 3, "range start out of range");
+    luaL_argcheck(L, count >= 0 && (size_t) count <= pixels->size - src && (size_t) count <= pixels->size - dst,
+        4, "range count out of range");
+    memmove(pixels->leds + dst, pixels->leds + src, count * sizeof(CRGB));
+    return 0;
+}
+
+// px.hsv2rgb(pixels [, from, count]), converts pixels holding packed 0xHHSSVV to rgb in place
+static int pxHsv2rgb(lua_State *L) {
+    LuaPixels *pixels = LuaPixels::check(L, 1);
+    size_t from, count;
+    checkRange(L, pixels, 2, from, count);
+    CRGB *leds = pixels->leds + from;
+    for (size_t i = 0; i < count; i++) {
+        hsv2rgb_rainbow(CHSV(leds[i].r, leds[i].g, leds[i].b), leds[i]);
+    }
+    return 0;
+}
+
+static const luaL_Reg pxFunctions[] = {
+    {"fill", pxFill},
+    {"gradient_hsv", pxGradientHsv},
+    {"fade_to_black", pxFadeToBlack},
+    {"blur1d", pxBlur1d},
+    {"shift", pxShift},
+    {"mirror", pxMirror},
+    {"copy_range", pxCopyRange},
+    {"hsv2rgb", pxHsv2rgb},
+    {NULL, NULL}
+};
+
+#ifdef LUA_USE_ROTABLES
+static const luaR_table pxRotable = {LUA_PX_LIBNAME, pxFunctions, NULL};
+#endif
+
+static int openPx(lua_State *L) {
+#ifdef LUA_USE_ROTABLES
+    lua_pushrotable(L, &pxRotable);
+#else
+    luaL_newlib(L, pxFunctions);
+#endif
+    return 1;
+}
+
+void LuaPx::registerLib(lua_State *L) {
+    luaL_requiref(L, LUA_PX_LIBNAME, openPx, 1);
+    lua_pop(L, 1);
+}
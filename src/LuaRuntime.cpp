@@ -0,0 +1,151 @@
+#include "LuaRuntime.h"
+
+static int luaPanic(lua_State *L) {
+    Serial.printf("PANIC: unprotected error in call to Lua API (%s)\n", lua_tostring(L, -1));
+    return 0;
+}
+
+GlobalAnimationEnv* LuaRuntime::envOf(lua_State *L) {
+    return (*(LuaRuntime**) lua_getextraspace(L))->getEnv();
+}
+
+static int envMillis(lua_State *L) {
+    lua_pushinteger(L, LuaRuntime::envOf(L)->timeMillis);
+    return 1;
+}
+
+static int envDt(lua_State *L) {
+    lua_pushinteger(L, LuaRuntime::envOf(L)->dtMillis);
+    return 1;
+}
+
+static int envIteration(lua_State *L) {
+    lua_pushinteger(L, LuaRuntime::envOf(L)->iteration);
+    return 1;
+}
+
+LuaRuntime::LuaRuntime() {
+    luaState = lua_newstate(LuaAllocator::alloc, &allocator);
+    if (luaState != nullptr) {
+        lua_atpanic(luaState, luaPanic);
+        // coroutines copy the extra space and the hook of the main thread. The hook stays installed
+        // so coroutines created while no budget is armed are counted once one is
+        *(LuaRuntime**) lua_getextraspace(luaState) = this;
+        lua_sethook(luaState, budgetHook, LUA_MASKCOUNT, LUA_HOOK_INSTRUCTIONS);
+    }
+}
+
+LuaRuntime::~LuaRuntime() {
+    if (luaState != nullptr) {
+        lua_close(luaState);
+    }
+}
+
+CallResult<void*> LuaRuntime::begin(GlobalAnimationEnv* globalAnimationEnv) {
+    if (luaState == nullptr) {
+        return CallResult<void*>(nullptr, 500, "Not enough memory to create lua state");
+    }
+
+    LuaRuntime::globalAnimationEnv = globalAnimationEnv;
+    luaL_openlibs(luaState);
+
+    luabridge::getGlobalNamespace(luaState)
+        .beginNamespace("env")
+        .addProperty("millis", envMillis)
+        .addProperty("dt", envDt)
+        .addProperty("iteration", envIteration)
+        .endNamespace();
+
+    LuaPixels::registerType(luaState);
+    LuaPx::registerLib(luaState);
+    LuaFx::registerLib(luaState);
+    return CallResult<void*>(nullptr, 200);
+}
+
+GlobalAnimationEnv* LuaRuntime::getEnv() {
+    return globalAnimationEnv;
+}
+
+lua_State* LuaRuntime::getState() {
+    return luaState;
+}
+
+LuaAllocator& LuaRuntime::getAllocator() {
+    return allocator;
+}
+
+void LuaRuntime::configureGc(bool scheduled, int pause, int stepMul) {
+    gcPause = pause;
+    if (luaState == nullptr) {
+        return;
+    }
+    lua_gc(luaState, LUA_GCSETPAUSE, pause);
+    lua_gc(luaState, LUA_GCSETSTEPMUL, stepMul);
+    lua_gc(luaState, scheduled ? LUA_GCSTOP : LUA_GCRESTART, 0);
+}
+
+// Steps the incremental collector until the deadline, cycles start once the heap grew by gcPause percent
+// since the last one like the automatic collector does. Returns true if a full collection was forced
+bool LuaRuntime::collectGarbage(uint32_t deadlineMicros, int stepKb, bool underPressure) {
+    if (underPressure) {
+        lua_gc(luaState, LUA_GCCOLLECT, 0);
+        gcCycleRunning = false;
+        gcBaseBytes = allocator.getUsedBytes();
+        return true;
+    }
+
+    if (!gcCycleRunning && allocator.getUsedBytes() < gcBaseBytes / 100 * gcPause) {
+        return false;
+    }
+
+    gcCycleRunning = true;
+    do {
+        if (lua_gc(luaState, LUA_GCSTEP, stepKb)) {
+            gcCycleRunning = false;
+            gcBaseBytes = allocator.getUsedBytes();
+            break;
+        }
+    } while ((int32_t) (micros() - deadlineMicros) < 0);
+    return false;
+}
+
+void LuaRuntime::setMemoryCap(size_t cap) {
+    memoryCap = cap;
+}
+
+void LuaRuntime::armBudget(uint32_t instructions, uint32_t micros) {
+    allocator.setCap(memoryCap);
+    budgetInstructions = instructions;
+    budgetMicros = micros;
+    budgetUsedInstructions = 0;
+    budgetStart = ::micros();
+    budgetExceeded = false;
+}
+
+void LuaRuntime::disarmBudget() {
+    allocator.setCap(0);
+    budgetInstructions = 0;
+    budgetMicros = 0;
+}
+
+bool LuaRuntime::isBudgetExceeded() {
+    return budgetExceeded;
+}
+
+void LuaRuntime::budgetHook(lua_State *L, lua_Debug *ar) {
+    LuaRuntime *runtime = *(LuaRuntime**) lua_getextraspace(L);
+    if (runtime->budgetInstructions == 0 && runtime->budgetMicros == 0) {
+        return;
+    }
+    runtime->budgetUsedInstructions += LUA_HOOK_INSTRUCTIONS;
+    bool overInstructions = runtime->budgetInstructions != 0 && runtime->budgetUsedInstructions > runtime->budgetInstructions;
+    bool overTime = runtime->budgetMicros != 0 && micros() - runtime->budgetStart > runtime->budgetMicros;
+    if (overInstructions) {
+        runtime->budgetExceeded = true;
+        luaL_error(L, "instruction budget of %d exceeded", (int) runtime->budgetInstructions);
+    }
+    if (overTime) {
+        runtime->budgetExceeded = true;
+        luaL_error(L, "time budget of %d us exceeded", (int) runtime->budgetMicros);
+    }
+}
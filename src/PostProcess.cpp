@@ -0,0 +1,163 @@
+#include "PostProcess.h"
+
+// pow is not constexpr, gamma curves are built at compile time from series of ln and exp
+static constexpr double lnOf(double x) {
+    int halvings = 0;
+    while (x < 0.5) {
+        x *= 2;
+        halvings++;
+    }
+    double y = (x - 1) / (x + 1);
+    double term = y;
+    double sum = 0;
+    for (int k = 1; k < 40; k += 2) {
+        sum += term / k;
+        term *= y * y;
+    }
+    return 2 * sum - halvings * 0.69314718055994530942;
+}
+
+static constexpr double expOf(double x) {
+    int squarings = 0;
+    while (x < -0.5) {
+        x /= 2;
+        squarings++;
+    }
+    double term = 1;
+    double sum = 1;
+    for (int k = 1; k < 20; k++) {
+        term *= x / k;
+        sum += term;
+    }
+    for (; squarings > 0; squarings--) {
+        sum *= sum;
+    }
+    return sum;
+}
+
+struct GammaTables {
+    uint8_t values[GAMMA_MAX - GAMMA_MIN + 1][256];
+};
+
+static constexpr GammaTables makeGammaTables() {
+    GammaTables tables{};
+    for (int gamma = GAMMA_MIN; gamma <= GAMMA_MAX; gamma++) {
+        for (int v = 1; v < 256; v++) {
+            tables.values[gamma - GAMMA_MIN][v] = (uint8_t) (expOf(lnOf(v / 255.0) * gamma / 10) * 255 + 0.5);
+        }
+    }
+    return tables;
+}
+
+// one curve per tenth of gamma, kept in flash
+static constexpr GammaTables gammaTables = makeGammaTables();
+
+PostProcess::PostProcess() {
+    buildTables();
+}
+
+void PostProcess::configure(uint8_t brightness, uint8_t gamma, uint32_t correction, uint16_t fadeMillis) {
+    PostProcess::targetBrightness = brightness;
+    PostProcess::gamma = constrain(gamma, GAMMA_MIN, GAMMA_MAX);
+    PostProcess::correction = correction;
+    PostProcess::fadeMillis = fadeMillis;
+    dirty = true;
+}
+
+bool PostProcess::isChanging() {
+    return dirty || brightness != targetBrightness;
+}
+
+bool PostProcess::update(uint32_t nowMillis) {
+    // a new target fades from now, not from the last frame shown before an idle stretch
+    uint32_t elapsed = dirty ? 0 : nowMillis - lastUpdateMillis;
+    lastUpdateMillis = nowMillis;
+    if (!isChanging()) {
+        return false;
+    }
+    dirty = false;
+
+    uint8_t target = targetBrightness;
+    uint32_t step = fadeMillis == 0 ? 255 : elapsed * 255 / fadeMillis;
+    if (step == 0) {
+        step = 1;
+    }
+    if (brightness < target) {
+        brightness = brightness + step < target ? brightness + step : target;
+    } else if (brightness > target) {
+        brightness = brightness > target + step ? brightness - step : target;
+    }
+    buildTables();
+    return true;
+}
+
+void PostProcess::buildTables() {
+    const uint8_t* curve = gammaTables.values[gamma - GAMMA_MIN];
+    for (int c = 0; c < 3; c++) {
+        uint32_t scale = (((correction >> (16 - c * 8)) & 0xFF) + 1) * (brightness + 1);
+        for (int v = 0; v < 256; v++) {
+            lut[c][v] = curve[v] * scale >> 16;
+        }
+    }
+}
+
+// channel sums for the power estimate are taken in the same pass, limiting rarely needs a second one
+void PostProcess::toWire(std::vector<LedOutput>& outputs, const CRGB* frame, CRGB* wire) {
+    uint32_t channelSums[3] = {0, 0, 0};
+    size_t offset = 0;
+    for (auto& output : outputs) {
+        // EOrder keeps the source channel of each wire byte in an octal digit
+        uint8_t first = (output.order >> 6) & 3;
+        uint8_t second = (output.order >> 3) & 3;
+        uint8_t third = output.order & 3;
+        const uint8_t* firstLut = lut[first];
+        const uint8_t* secondLut = lut[second];
+        const uint8_t* thirdLut = lut[third];
+        uint32_t firstSum = 0;
+        uint32_t secondSum = 0;
+        uint32_t thirdSum = 0;
+        for (size_t i = offset; i < offset + output.length; i++) {
+            firstSum += wire[i].raw[0] = firstLut[frame[i].raw[first]];
+            secondSum += wire[i].raw[1] = secondLut[frame[i].raw[second]];
+            thirdSum += wire[i].raw[2] = thirdLut[frame[i].raw[third]];
+        }
+        channelSums[first] += firstSum;
+        channelSums[second] += secondSum;
+        channelSums[third] += thirdSum;
+        offset += output.length;
+    }
+    limitPower(wire, offset, channelSums);
+}
+
+void PostProcess::limitPower(CRGB* wire, size_t size, uint32_t* channelSums) {
+    uint32_t idle = size * POWER_IDLE_MA;
+    uint32_t lit = (channelSums[0] * POWER_RED_MA + channelSums[1] * POWER_GREEN_MA + channelSums[2] * POWER_BLUE_MA) / 255;
+    requestedMilliamps = idle + lit;
+    milliamps = requestedMilliamps;
+
+    uint32_t budget = powerBudget;
+    if (budget == 0 || requestedMilliamps <= budget) {
+        return;
+    }
+    // only the lit part scales, dark leds draw their idle current anyway
+    uint8_t scale = budget > idle ? (uint64_t) (budget - idle) * 255 / lit : 0;
+    nscale8(wire, size, scale);
+    milliamps = idle + lit * scale / 256;
+    limitedFrames++;
+}
+
+void PostProcess::setPowerBudget(uint32_t milliamps) {
+    powerBudget = milliamps;
+}
+
+uint32_t PostProcess::getRequestedMilliamps() {
+    return requestedMilliamps;
+}
+
+uint32_t PostProcess::getMilliamps() {
+    return milliamps;
+}
+
+uint32_t PostProcess::getLimitedFrames() {
+    return limitedFrames;
+}
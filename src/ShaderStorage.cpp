@@ -3,9 +3,40 @@
 #include <FS.h>
 #include <SD.h>
 #include <SPI.h>
+#include <lua.hpp>
 
 #define SD_CS 5
 
+// bytecode files start with the magic and the hash of the source they were compiled from
+#define BYTECODE_MAGIC 0x43424C47
+#define BYTECODE_HEADER_SIZE 8
+
+static uint32_t sourceHash(const String& code) {
+    uint32_t hash = 2166136261u;
+    for (unsigned int i = 0; i < code.length(); i++) {
+        hash ^= (uint8_t) code[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static void putUint32(std::vector<uint8_t>& out, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        out.push_back(value >> (i * 8));
+    }
+}
+
+static uint32_t getUint32(const uint8_t* in) {
+    return in[0] | (in[1] << 8) | (in[2] << 16) | ((uint32_t) in[3] << 24);
+}
+
+static int bytecodeWriter(lua_State *L, const void *data, size_t size, void *ud) {
+    std::vector<uint8_t> *out = (std::vector<uint8_t>*) ud;
+    const uint8_t *bytes = (const uint8_t*) data;
+    out->insert(out->end(), bytes, bytes + size);
+    return 0;
+}
+
 ShaderStorage::ShaderStorage() {
     if(!SD.begin(SD_CS)) {
     Serial.println("Card Mount Failed");
@@ -22,6 +53,12 @@ ShaderStorage::ShaderStorage() {
             Serial.println("Can not create shader dir");
         }
     }
+    if (!SD.exists(bytecodeDirectory)) {
+        Serial.println("Bytecode dir did not exist, creating");
+        if (!SD.mkdir(bytecodeDirectory)) {
+            Serial.println("Can not create bytecode dir");
+        }
+    }
     if (!SD.exists(propertiesDirectory)) {
         Serial.println("Properties dir did not exist, creating");
         if (!SD.mkdir(propertiesDirectory)) {
@@ -34,16 +71,56 @@ ShaderStorage::~ShaderStorage() {
     SD.end();
 }
 
-CallResult<void*> ShaderStorage::storeShader(const String& name, const String& code) {
+CallResult<ShaderCompileStats> ShaderStorage::storeShader(const String& name, const String& code) {
     CallResult<void*> result = writeFile(shaderFolderFile(name), code);
 
     if (result.hasError()) {
-        return result;
+        return CallResult<ShaderCompileStats>(ShaderCompileStats(), result.getCode(), result.getMessage().c_str());
+    }
+
+    CallResult<ShaderCompileStats> compileResult = compileShader(name, code);
+    if (compileResult.hasError()) {
+        Serial.printf("Shader %s stored without bytecode: %s\n", name.c_str(), compileResult.getMessage().c_str());
+        SD.remove(bytecodeFolderFile(name));
     }
+
     if (listener != nullptr) {
         listener->animationAdded(name);
     }
-    return result;
+    return CallResult<ShaderCompileStats>(compileResult.getValue());
+}
+
+CallResult<ShaderCompileStats> ShaderStorage::compileShader(const String& name, const String& code) {
+    ShaderCompileStats stats;
+    String chunkName = "=" + name;
+    lua_State *luaState = luaL_newstate();
+
+    uint32_t start = micros();
+    int loadCode = luaL_loadbufferx(luaState, code.c_str(), code.length(), chunkName.c_str(), "t");
+    stats.sourceLoadMicros = micros() - start;
+    if (loadCode) {
+        CallResult<ShaderCompileStats> result(stats, 400, "%s", lua_tostring(luaState, -1));
+        lua_close(luaState);
+        return result;
+    }
+
+    std::vector<uint8_t> bytecode;
+    putUint32(bytecode, BYTECODE_MAGIC);
+    putUint32(bytecode, sourceHash(code));
+    lua_dump(luaState, bytecodeWriter, &bytecode, 1);
+    lua_pop(luaState, 1);
+    stats.bytecodeSize = bytecode.size() - BYTECODE_HEADER_SIZE;
+
+    start = micros();
+    luaL_loadbufferx(luaState, (const char*) bytecode.data() + BYTECODE_HEADER_SIZE, stats.bytecodeSize, chunkName.c_str(), "b");
+    stats.bytecodeLoadMicros = micros() - start;
+    lua_close(luaState);
+
+    CallResult<void*> writeResult = writeBinaryFile(bytecodeFolderFile(name), bytecode);
+    if (writeResult.hasError()) {
+        return CallResult<ShaderCompileStats>(stats, writeResult.getCode(), writeResult.getMessage().c_str());
+    }
+    return CallResult<ShaderCompileStats>(stats);
 }
 
 bool ShaderStorage::hasShader(const String& name) const {
@@ -54,7 +131,25 @@ CallResult<String> ShaderStorage::getShader(const String& name) const {
     return readFile(shaderFolderFile(name));
 }
 
+CallResult<std::vector<uint8_t>*> ShaderStorage::getBytecode(const String& name, const String& code) const {
+    CallResult<std::vector<uint8_t>*> result = readBinaryFile(bytecodeFolderFile(name));
+    if (result.hasError()) {
+        return result;
+    }
+
+    std::vector<uint8_t>* bytecode = result.getValue();
+    if (bytecode->size() <= BYTECODE_HEADER_SIZE
+        || getUint32(bytecode->data()) != BYTECODE_MAGIC
+        || getUint32(bytecode->data() + 4) != sourceHash(code)) {
+        delete bytecode;
+        return CallResult<std::vector<uint8_t>*>(nullptr, 409, "stale bytecode for %s", name.c_str());
+    }
+    bytecode->erase(bytecode->begin(), bytecode->begin() + BYTECODE_HEADER_SIZE);
+    return result;
+}
+
 bool ShaderStorage::deleteShader(const String& name) {
+    SD.remove(bytecodeFolderFile(name));
     bool result = SD.remove(shaderFolderFile(name));
     if (listener != nullptr && result) {
         listener->animationRemoved(name);
@@ -66,6 +161,10 @@ String ShaderStorage::shaderFolderFile(const String& name) const {
     return shaderDirectory + "/" + name;
 }
 
+String ShaderStorage::bytecodeFolderFile(const String& name) const {
+    return bytecodeDirectory + "/" + name;
+}
+
 CallResult<std::vector<String>*> ShaderStorage::listShaders() const {
     File root = SD.open(shaderDirectory);
     File file = root.openNextFile();
@@ -97,6 +196,14 @@ String ShaderStorage::getLastShader() const{
     return getProperty("lastShader");
 }
 
+void ShaderStorage::saveOutputs(const String& outputs) {
+    saveProperty("outputs", outputs);
+}
+
+String ShaderStorage::getOutputs() const{
+    return getProperty("outputs");
+}
+
 void ShaderStorage::saveProperty(const String& name, const String& value) {
     if (getProperty(name) != value) {
         writeFile(propertiesDirectory + "/" + name, value);
@@ -138,3 +245,33 @@ CallResult<String> ShaderStorage::readFile(const String& name) const {
     String result = file.readString();
     return CallResult<String>(result);
 }
+
+CallResult<void*> ShaderStorage::writeBinaryFile(const String& name, const std::vector<uint8_t>& value) {
+    File file = SD.open(name, FILE_WRITE);
+
+    if (!file) {
+        return CallResult<void*>(nullptr, 500, "error opening file %s for writing", name.c_str());
+    }
+
+    if (file.write(value.data(), value.size()) != value.size()) {
+        return CallResult<void*>(nullptr, 500, "error writing file %s", name.c_str());
+    }
+
+    file.close();
+    return CallResult<void*>(nullptr);
+}
+
+CallResult<std::vector<uint8_t>*> ShaderStorage::readBinaryFile(const String& name) const {
+    File file = SD.open(name, FILE_READ);
+
+    if (!file) {
+        return CallResult<std::vector<uint8_t>*>(nullptr, 404, "no file %s", name.c_str());
+    }
+
+    std::vector<uint8_t>* result = new std::vector<uint8_t>(file.size());
+    if (file.read(result->data(), result->size()) != result->size()) {
+        delete result;
+        return CallResult<std::vector<uint8_t>*>(nullptr, 500, "error reading file %s", name.c_str());
+    }
+    return CallResult<std::vector<uint8_t>*>(result);
+}
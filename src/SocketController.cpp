@@ -42,8 +42,48 @@ void SocketController::handleWebSocketMessage(void *arg, uint8_t *data, size_t l
         String control = String((char*) data);
         Serial.println("Control sequence: " + control);
         if (control.startsWith("select ")) {
-            String shaderName = control.substring(7);
-            animationManager->select(shaderName);
+            // select <name> [<transition> [<millis>]]
+            String arguments = control.substring(7);
+            int nameEnd = arguments.indexOf(' ');
+            String shaderName = nameEnd < 0 ? arguments : arguments.substring(0, nameEnd);
+            RenderSettings settings = animationManager->getSettings();
+            Transition transition(settings.transition, settings.transitionMillis);
+            if (nameEnd >= 0) {
+                String transitionArguments = arguments.substring(nameEnd + 1);
+                int typeEnd = transitionArguments.indexOf(' ');
+                CallResult<TransitionType> typeResult = Transition::typeFromName(
+                    typeEnd < 0 ? transitionArguments : transitionArguments.substring(0, typeEnd));
+                if (typeResult.hasError()) {
+                    animationSelectFailed(shaderName, typeResult.getMessage());
+                    return;
+                }
+                transition.type = typeResult.getValue();
+                if (typeEnd >= 0) {
+                    transition.durationMillis = constrain(transitionArguments.substring(typeEnd + 1).toInt(), 0, TRANSITION_MAX_MILLIS);
+                }
+            }
+            // clients hear of the selection once the shader renders
+            CallResult<void*> result = animationManager->select(shaderName, transition);
+            if (result.hasError()) {
+                animationSelectFailed(shaderName, result.getMessage());
+            }
+        }
+        else if (control == "next") {
+            animationManager->next();
+        }
+        else if (control == "previous") {
+            animationManager->previous();
+        }
+        else if (control.startsWith("brightness ")) {
+            RenderSettings settings = animationManager->getSettings();
+            settings.brightness = constrain(control.substring(11).toInt(), 0, 255);
+            animationManager->updateSettings(settings);
+            textAll(control);
+        }
+        else if (control.startsWith("gamma ")) {
+            RenderSettings settings = animationManager->getSettings();
+            settings.gamma = constrain(control.substring(6).toInt(), GAMMA_MIN, GAMMA_MAX);
+            animationManager->updateSettings(settings);
             textAll(control);
         }
     }
@@ -61,6 +101,10 @@ void SocketController::animationSelected(String name) {
     ws->textAll("select " + name);
 }
 
+void SocketController::animationSelectFailed(String name, String message) {
+    ws->textAll("failed " + name + " " + message);
+}
+
 void SocketController::animationAdded(String name) {
     ws->textAll("add " + name);
 }
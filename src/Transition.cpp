@@ -0,0 +1,54 @@
+#include "Transition.h"
+
+Transition::Transition(TransitionType type, uint16_t durationMillis) {
+    Transition::type = type;
+    Transition::durationMillis = constrain(durationMillis, 0, TRANSITION_MAX_MILLIS);
+}
+
+bool Transition::isCut() {
+    return type == TRANSITION_CUT || durationMillis == 0;
+}
+
+void Transition::apply(const CRGB* outgoing, const CRGB* incoming, CRGB* blended, size_t size, uint8_t progress) {
+    switch (type) {
+        case TRANSITION_CROSSFADE:
+            blend(outgoing, incoming, blended, size, progress);
+            break;
+        case TRANSITION_WIPE: {
+            // the incoming shader moves in from the start of the strip
+            size_t edge = (uint32_t) size * progress / 255;
+            memcpy(blended, incoming, edge * sizeof(CRGB));
+            memcpy(blended + edge, outgoing + edge, (size - edge) * sizeof(CRGB));
+            break;
+        }
+        case TRANSITION_DISSOLVE:
+            // every led fades over half the duration, starting at its own scattered point in time
+            for (size_t i = 0; i < size; i++) {
+                uint8_t start = ((uint32_t) i * 2654435761u) >> 24;
+                int amount = progress * 2 - start;
+                blended[i] = blend(outgoing[i], incoming[i], constrain(amount, 0, 255));
+            }
+            break;
+        default:
+            memcpy(blended, incoming, size * sizeof(CRGB));
+            break;
+    }
+}
+
+CallResult<TransitionType> Transition::typeFromName(const String& name) {
+    for (int type = TRANSITION_CUT; type <= TRANSITION_DISSOLVE; type++) {
+        if (name == typeName((TransitionType) type)) {
+            return CallResult<TransitionType>((TransitionType) type);
+        }
+    }
+    return CallResult<TransitionType>(TRANSITION_CUT, 400, "Unknown transition %s", name.c_str());
+}
+
+const char* Transition::typeName(TransitionType type) {
+    switch (type) {
+        case TRANSITION_CROSSFADE: return "crossfade";
+        case TRANSITION_WIPE: return "wipe";
+        case TRANSITION_DISSOLVE: return "dissolve";
+        default: return "cut";
+    }
+}
@@ -18,6 +18,12 @@
 
 const uint8_t LED_PIN = 32;
 
+// outputs used until others are saved with POST /api/outputs,
+// further strips go on pins of their own, e.g. LedOutput(33, 150, GRB, CHIPSET_WS2811)
+std::vector<LedOutput> ledOutputs = {
+  LedOutput(LED_PIN, NUM_LEDS)
+};
+
 DNSServer dnsServer;
 AsyncWebServer server(80);
 
@@ -30,12 +36,12 @@ SocketController *socket;
 CallResult<void*> status(nullptr);
 
 uint32_t loopTimestampMillis = 0;
-uint32_t loopIteration = 0;
 
 long leftClickMillis = 0;
 long rightClickMillis = 0;
 
 void handleButtons();
+void loadOutputs();
 void onLeftClick();
 void onRightClick();
 
@@ -84,8 +90,10 @@ void setup() {
     request->send_P(200, "text/plain", "pong");
   });
 
+  // connected, the result of the last frame
   server.on("/health", HTTP_GET, [](AsyncWebServerRequest *request){
-    request->send_P((int) status.getCode(), "text/plain", status.getMessage().c_str());
+    CallResult<void*> health = status.hasError() ? status : anime->getDrawResult();
+    request->send_P((int) health.getCode(), "text/plain", health.getMessage().c_str());
   });
 
   server.on("/", HTTP_GET, [](AsyncWebServerRequest *request){
@@ -102,6 +110,18 @@ void setup() {
   shaderPost->setMethod(HTTP_POST);
   server.addHandler(shaderPost);
 
+  auto outputsPost = new AsyncCallbackJsonWebHandler("/api/outputs", [](AsyncWebServerRequest *request, JsonVariant &json) {
+    apiController->onSetOutputs(request, json);
+  });
+  outputsPost->setMethod(HTTP_POST);
+  server.addHandler(outputsPost);
+
+  auto settingsPost = new AsyncCallbackJsonWebHandler("/api/settings", [](AsyncWebServerRequest *request, JsonVariant &json) {
+    apiController->onSetSettings(request, json);
+  });
+  settingsPost->setMethod(HTTP_POST);
+  server.addHandler(settingsPost);
+
   server.on("^\\/api\\/show\\/([a-zA-Z0-9_-]+)$", HTTP_GET, [] (AsyncWebServerRequest *request) {
     String path = request->pathArg(0);
     apiController->onShow(path, request);
@@ -117,6 +137,11 @@ void setup() {
     apiController->onDeleteShader(path, request);
   });
 
+  server.on("^\\/api\\/shader\\/([a-zA-Z0-9_-]+)\\/subsample$", HTTP_POST, [] (AsyncWebServerRequest *request) {
+    String path = request->pathArg(0);
+    apiController->onSetSubsample(path, request);
+  });
+
   server.on("/api/shader", HTTP_GET, [] (AsyncWebServerRequest *request){
     apiController->onListShaders(request);
   });
@@ -125,6 +150,27 @@ void setup() {
     apiController->onGetShow(request);
   });
 
+  server.on("/api/settings", HTTP_GET, [] (AsyncWebServerRequest *request){
+    apiController->onGetSettings(request);
+  });
+
+  server.on("/api/outputs", HTTP_GET, [] (AsyncWebServerRequest *request){
+    apiController->onGetOutputs(request);
+  });
+
+  server.on("/api/stats", HTTP_GET, [] (AsyncWebServerRequest *request){
+    apiController->onGetStats(request);
+  });
+
+  // before /api/benchmark/fx, which also matches paths below it
+  server.on("/api/benchmark/fx/result", HTTP_GET, [] (AsyncWebServerRequest *request){
+    apiController->onGetBenchmarkFx(request);
+  });
+
+  server.on("/api/benchmark/fx", HTTP_GET, [] (AsyncWebServerRequest *request){
+    apiController->onBenchmarkFx(request);
+  });
+
   globalAnimationEnv = new GlobalAnimationEnv();
   shaderStorage = new ShaderStorage();
   anime = new AnimationManager(shaderStorage, globalAnimationEnv);
@@ -136,28 +182,48 @@ void setup() {
 
   apiController = new ApiController(shaderStorage, anime);
 
-  status = anime->connect<LED_PIN>(NUM_LEDS);
+  loadOutputs();
+  status = anime->connect(ledOutputs);
   while (status.hasError()) {
     Serial.println(status.getMessage());
     delay(1000);
-    status = anime->connect<LED_PIN>(NUM_LEDS);
+    status = anime->connect(ledOutputs);
   }
 
   server.begin();
   Serial.println("http://led.local/");
 }
 
+// frames are rendered and shown by the animation manager tasks
 void loop() {
   loopTimestampMillis = millis();
-  loopIteration++;
 
   socket->cleanUp();
+  handleButtons();
 
-  globalAnimationEnv->timeMillis = loopTimestampMillis;
-  globalAnimationEnv->iteration = loopIteration;
+  if (apiController->isRestartRequested()) {
+    // lets the response go out first
+    delay(500);
+    ESP.restart();
+  }
+}
 
-  status = anime->draw();
-  handleButtons();
+void loadOutputs() {
+  String saved = shaderStorage->getOutputs();
+  if (saved == "") {
+    return;
+  }
+  DynamicJsonDocument json(saved.length() * 2 + 256);
+  if (deserializeJson(json, saved)) {
+    Serial.println("Saved outputs are not json, using defaults");
+    return;
+  }
+  CallResult<std::vector<LedOutput>> result = LedOutputs::fromJson(json.as<JsonArrayConst>());
+  if (result.hasError()) {
+    Serial.printf("Saved outputs are invalid, using defaults: %s\n", result.getMessage().c_str());
+    return;
+  }
+  ledOutputs = result.getValue();
 }
 
 void handleButtons() {